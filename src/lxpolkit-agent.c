@@ -0,0 +1,124 @@
+/*
+ *      lxpolkit-agent.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-agent.h"
+#include <stdio.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+static gboolean trace = FALSE;
+static gint64 start_time;
+
+typedef struct _AgentRegistration AgentRegistration;
+struct _AgentRegistration
+{
+    PolkitSubject* session;
+    char* object_path;
+};
+
+static void agent_registration_free(AgentRegistration* reg)
+{
+    if(reg->session)
+        g_object_unref(reg->session);
+    g_free(reg->object_path);
+    g_slice_free(AgentRegistration, reg);
+}
+
+/* polkit has no asynchronous registration, so it runs in a worker thread.
+ * The worker has no main context of its own, so the agent object is still
+ * served by the main loop. */
+static void register_listener(GTask* task, gpointer source, gpointer task_data, GCancellable* cancellable)
+{
+    AgentRegistration* reg = (AgentRegistration*)task_data;
+    GError* err = NULL;
+    if(polkit_agent_register_listener(POLKIT_AGENT_LISTENER(source), reg->session, reg->object_path, &err))
+        g_task_return_boolean(task, TRUE);
+    else
+        g_task_return_error(task, err);
+}
+
+static void on_session(GObject* source, GAsyncResult* res, gpointer user_data)
+{
+    GTask* task = (GTask*)user_data;
+    AgentRegistration* reg = (AgentRegistration*)g_task_get_task_data(task);
+    GError* err = NULL;
+    reg->session = polkit_unix_session_new_for_process_finish(res, &err);
+    if(!reg->session)
+        g_task_return_error(task, err);
+    else {
+        lxpolkit_agent_trace("session found");
+        g_task_run_in_thread(task, register_listener);
+    }
+    g_object_unref(task);
+}
+
+void lxpolkit_agent_register(PolkitAgentListener* listener, PolkitSubject* session, const char* object_path,
+                             GAsyncReadyCallback callback, gpointer user_data)
+{
+    GTask* task = g_task_new(listener, NULL, callback, user_data);
+    AgentRegistration* reg = g_slice_new0(AgentRegistration);
+    reg->object_path = g_strdup(object_path);
+    g_task_set_task_data(task, reg, (GDestroyNotify)agent_registration_free);
+    if(session) {
+        reg->session = (PolkitSubject*)g_object_ref(session);
+        g_task_run_in_thread(task, register_listener);
+        g_object_unref(task);
+    } else
+        polkit_unix_session_new_for_process(getpid(), NULL, on_session, task);
+}
+
+gboolean lxpolkit_agent_register_finish(PolkitAgentListener* listener, GAsyncResult* res, GError** error)
+{
+    return g_task_propagate_boolean(G_TASK(res), error);
+}
+
+void lxpolkit_agent_trace_start(void)
+{
+    start_time = g_get_monotonic_time();
+}
+
+void lxpolkit_agent_set_trace(gboolean enable)
+{
+    trace = enable;
+}
+
+long lxpolkit_agent_get_rss(void)
+{
+    char line[128];
+    long rss = -1;
+    FILE* f = fopen("/proc/self/status", "r");
+    if(!f)
+        return -1;
+    while(fgets(line, sizeof(line), f))
+        if(sscanf(line, "VmRSS: %ld", &rss) == 1)
+            break;
+    fclose(f);
+    return rss;
+}
+
+void lxpolkit_agent_trace(const char* phase)
+{
+    if(trace)
+        g_printerr("%s: %8.2f ms, %6ld kB RSS: %s\n", g_get_prgname(),
+                   (g_get_monotonic_time() - start_time) / 1000.0, lxpolkit_agent_get_rss(), phase);
+}
@@ -0,0 +1,52 @@
+/*
+ *      lxpolkit-agent.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_AGENT_H__
+#define __LXPOLKIT_AGENT_H__
+
+#define POLKIT_AGENT_I_KNOW_API_IS_SUBJECT_TO_CHANGE
+#include <polkitagent/polkitagent.h>
+
+G_BEGIN_DECLS
+
+/* Startup shared by the GTK+ agent and the text agent. */
+
+/* Register listener as the authentication agent of session, or of the
+ * session of this process if it is NULL, without blocking the main loop.
+ * object_path is where the agent is exported, NULL for the polkit default;
+ * each listener of a process needs its own. */
+void lxpolkit_agent_register(PolkitAgentListener* listener, PolkitSubject* session, const char* object_path,
+                             GAsyncReadyCallback callback, gpointer user_data);
+gboolean lxpolkit_agent_register_finish(PolkitAgentListener* listener, GAsyncResult* res, GError** error);
+
+/* Call first thing in main(); the trace counts from there. */
+void lxpolkit_agent_trace_start(void);
+void lxpolkit_agent_set_trace(gboolean enable);
+
+/* If tracing is enabled, print the time since the start of the process
+ * and the resident set size once phase is done. */
+void lxpolkit_agent_trace(const char* phase);
+
+/* VmRSS of /proc/self/status, in kB, or -1 without procfs. */
+long lxpolkit_agent_get_rss(void);
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_AGENT_H__ */
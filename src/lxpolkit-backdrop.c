@@ -0,0 +1,468 @@
+/*
+ *      lxpolkit-backdrop.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-backdrop.h"
+#include "lxpolkit-blur.h"
+#include "lxpolkit-dim.h"
+#include "lxpolkit-stats.h"
+
+#ifdef GDK_WINDOWING_X11
+#include <gdk/gdkx.h>
+#endif
+
+#ifndef GDK_WINDOWING_X11
+#undef HAVE_XSHM
+#endif
+
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif
+
+#ifdef G_ENABLE_DEBUG
+#define DEBUG(...)  g_debug(__VA_ARGS__)
+#else
+#define DEBUG(...)
+#endif
+
+/* The capture shows whatever windows were on screen at the time, so it is
+ * only reused for prompts arriving shortly after it was taken. */
+#define BACKDROP_MAX_AGE    (5 * G_USEC_PER_SEC)
+#define BACKDROP_MAX_SCALE  8
+
+/* The frosted backdrop is blurred at 1/8 of the monitor size with three
+ * box passes of radius 2, roughly a Gaussian of 20 pixels on screen. */
+#define BACKDROP_BLUR_SCALE     8
+#define BACKDROP_BLUR_RADIUS    2
+#define BACKDROP_BLUR_PASSES    3
+
+/* Where a captured surface goes on the screen, kept as surface user data. */
+typedef struct _BackdropGeometry BackdropGeometry;
+struct _BackdropGeometry
+{
+    GdkRectangle area;      /* monitor geometry in root window coordinates */
+    int scale;
+    int x, y;               /* origin of the window showing it, in the same coordinates */
+};
+
+static cairo_user_data_key_t geometry_key;
+
+struct _LXPolkitBackdrop
+{
+    cairo_surface_t* surface;
+    gint64 captured;        /* monotonic time the surface was taken */
+    int monitor;            /* monitor the surface shows */
+    int scale;              /* the surface is 1/scale of the monitor size */
+    gboolean blur;          /* frosted instead of only darkened */
+    GdkScreen* screen;      /* screen we watch for changes, NULL until first used */
+    int overlay;            /* last reported mode: -1 not yet, 0 capture, 1 translucent overlay */
+};
+
+LXPolkitBackdrop* lxpolkit_backdrop_new(void)
+{
+    LXPolkitBackdrop* backdrop = g_slice_new0(LXPolkitBackdrop);
+    backdrop->overlay = -1;
+    backdrop->scale = 1;
+    return backdrop;
+}
+
+void lxpolkit_backdrop_set_scale(LXPolkitBackdrop* backdrop, int scale)
+{
+    scale = CLAMP(scale, 1, BACKDROP_MAX_SCALE);
+    if(scale != backdrop->scale) {
+        lxpolkit_backdrop_invalidate(backdrop);
+        backdrop->scale = scale;
+    }
+}
+
+void lxpolkit_backdrop_set_blur(LXPolkitBackdrop* backdrop, gboolean blur)
+{
+    if(blur != backdrop->blur) {
+        lxpolkit_backdrop_invalidate(backdrop);
+        backdrop->blur = blur;
+    }
+}
+
+void lxpolkit_backdrop_invalidate(LXPolkitBackdrop* backdrop)
+{
+    if(backdrop->surface) {
+        DEBUG("backdrop invalidated");
+        cairo_surface_destroy(backdrop->surface);
+        backdrop->surface = NULL;
+    }
+}
+
+static void on_screen_changed(GdkScreen* screen, LXPolkitBackdrop* backdrop)
+{
+    lxpolkit_backdrop_invalidate(backdrop);
+}
+
+#ifdef GDK_WINDOWING_X11
+/* The desktop sets _XROOTPMAP_ID on the root window whenever the wallpaper changes. */
+static GdkFilterReturn on_root_event(GdkXEvent* xevent, GdkEvent* event, LXPolkitBackdrop* backdrop)
+{
+    XEvent* xev = (XEvent*)xevent;
+    if(xev->type == PropertyNotify &&
+       xev->xproperty.atom == gdk_x11_get_xatom_by_name_for_display(gdk_screen_get_display(backdrop->screen), "_XROOTPMAP_ID"))
+        lxpolkit_backdrop_invalidate(backdrop);
+    return GDK_FILTER_CONTINUE;
+}
+#endif
+
+static void backdrop_watch_screen(LXPolkitBackdrop* backdrop, GdkScreen* screen)
+{
+    backdrop->screen = (GdkScreen*)g_object_ref(screen);
+    g_signal_connect(screen, "monitors-changed", G_CALLBACK(on_screen_changed), backdrop);
+    g_signal_connect(screen, "size-changed", G_CALLBACK(on_screen_changed), backdrop);
+    g_signal_connect(screen, "composited-changed", G_CALLBACK(on_screen_changed), backdrop);
+#ifdef GDK_WINDOWING_X11
+    if(GDK_IS_X11_SCREEN(screen)) {
+        GdkWindow* root = gdk_screen_get_root_window(screen);
+        gdk_window_set_events(root, gdk_window_get_events(root) | GDK_PROPERTY_CHANGE_MASK);
+        gdk_window_add_filter(root, (GdkFilterFunc)on_root_event, backdrop);
+    }
+#endif
+}
+
+void lxpolkit_backdrop_set_screen(LXPolkitBackdrop* backdrop, GdkScreen* screen)
+{
+    if(!backdrop->screen)
+        backdrop_watch_screen(backdrop, screen);
+}
+
+static void backdrop_ensure_screen(LXPolkitBackdrop* backdrop)
+{
+    if(!backdrop->screen)
+        backdrop_watch_screen(backdrop, gdk_screen_get_default());
+}
+
+void lxpolkit_backdrop_free(LXPolkitBackdrop* backdrop)
+{
+    if(backdrop->screen) {
+#ifdef GDK_WINDOWING_X11
+        if(GDK_IS_X11_SCREEN(backdrop->screen))
+            gdk_window_remove_filter(gdk_screen_get_root_window(backdrop->screen), (GdkFilterFunc)on_root_event, backdrop);
+#endif
+        g_signal_handlers_disconnect_by_func(backdrop->screen, on_screen_changed, backdrop);
+        g_object_unref(backdrop->screen);
+    }
+    lxpolkit_backdrop_invalidate(backdrop);
+    g_slice_free(LXPolkitBackdrop, backdrop);
+}
+
+/* Dimmed captures are uploaded once into a surface similar to the root
+ * window. The fullscreen dialog uses the same visual, so painting it later
+ * is a server side copy instead of a full pixbuf conversion per expose. */
+static cairo_surface_t* backdrop_upload(GdkWindow* root, int width, int height, cairo_t** cr)
+{
+    cairo_surface_t* surface = gdk_window_create_similar_surface(root, CAIRO_CONTENT_COLOR, width, height);
+    *cr = cairo_create(surface);
+    cairo_set_operator(*cr, CAIRO_OPERATOR_SOURCE);
+    return surface;
+}
+
+#ifdef HAVE_XSHM
+/* Read the root window straight into a shared memory XImage and darken it
+ * there. Only 24 bit TrueColor in host byte order is handled, which is the
+ * layout of CAIRO_FORMAT_RGB24; anything else falls back to the GDK path. */
+static cairo_surface_t* backdrop_capture_shm(GdkScreen* screen, const GdkRectangle* area)
+{
+    int width = area->width, height = area->height;
+    GdkDisplay* display = gdk_screen_get_display(screen);
+    Display* dpy = GDK_DISPLAY_XDISPLAY(display);
+    GdkWindow* root = gdk_screen_get_root_window(screen);
+    GdkVisual* visual = gdk_screen_get_system_visual(screen);
+    XShmSegmentInfo shminfo;
+    XImage* image;
+    cairo_surface_t* source, *surface = NULL;
+    cairo_t* cr;
+    gboolean ok;
+    int xerr;
+
+    if(!XShmQueryExtension(dpy) || gdk_visual_get_depth(visual) != 24)
+        return NULL;
+
+    image = XShmCreateImage(dpy, GDK_VISUAL_XVISUAL(visual), 24, ZPixmap, NULL, &shminfo, width, height);
+    if(!image)
+        return NULL;
+    if(image->bits_per_pixel != 32 ||
+       image->red_mask != 0xff0000 || image->green_mask != 0xff00 || image->blue_mask != 0xff ||
+       image->byte_order != (G_BYTE_ORDER == G_LITTLE_ENDIAN ? LSBFirst : MSBFirst) ||
+       image->bytes_per_line != cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, width)) {
+        XDestroyImage(image);
+        return NULL;
+    }
+
+    shminfo.shmid = shmget(IPC_PRIVATE, (gsize)image->bytes_per_line * height, IPC_CREAT | 0600);
+    if(shminfo.shmid < 0) {
+        XDestroyImage(image);
+        return NULL;
+    }
+    shminfo.shmaddr = image->data = shmat(shminfo.shmid, NULL, 0);
+    shminfo.readOnly = False;
+    if(shminfo.shmaddr == (char*)-1) {
+        shmctl(shminfo.shmid, IPC_RMID, NULL);
+        image->data = NULL;
+        XDestroyImage(image);
+        return NULL;
+    }
+
+    gdk_x11_display_error_trap_push(display);
+    ok = XShmAttach(dpy, &shminfo);
+    XSync(dpy, False);
+    /* the segment goes away by itself once both sides have detached. */
+    shmctl(shminfo.shmid, IPC_RMID, NULL);
+    /* pop the trap even if the attach failed, or it would swallow later errors */
+    xerr = gdk_x11_display_error_trap_pop(display);
+    if(ok && xerr == 0) {
+        gdk_x11_display_error_trap_push(display);
+        ok = XShmGetImage(dpy, GDK_WINDOW_XID(root), image, area->x, area->y, AllPlanes);
+        if(gdk_x11_display_error_trap_pop(display) != 0)
+            ok = FALSE;
+
+        if(ok) {
+            /* Darken every byte: the padding byte does not matter and this
+             * way the result is independent of the byte order. */
+            lxpolkit_dim_pixels((guchar*)image->data, width * 4, height, image->bytes_per_line, 1);
+            source = cairo_image_surface_create_for_data((guchar*)image->data, CAIRO_FORMAT_RGB24,
+                                                         width, height, image->bytes_per_line);
+            surface = backdrop_upload(root, width, height, &cr);
+            cairo_set_source_surface(cr, source, 0, 0);
+            cairo_paint(cr);
+            cairo_destroy(cr);
+            cairo_surface_destroy(source);
+        }
+        XShmDetach(dpy, &shminfo);
+        XSync(dpy, False);
+    }
+    else
+        ok = FALSE;
+
+    shmdt(shminfo.shmaddr);
+    image->data = NULL;
+    XDestroyImage(image);
+    DEBUG("MIT-SHM capture %s", ok ? "succeeded" : "failed");
+    return surface;
+}
+#endif
+
+/* Capture the root window through a pixbuf and make it darker. */
+static cairo_surface_t* backdrop_capture_pixbuf(GdkScreen* screen, const GdkRectangle* area)
+{
+    GdkWindow* root = gdk_screen_get_root_window(screen);
+    GdkPixbuf* pixbuf = gdk_pixbuf_get_from_window(root, area->x, area->y, area->width, area->height);
+    cairo_surface_t* surface;
+    cairo_t* cr;
+
+    if(pixbuf == NULL)
+        return NULL;
+
+    lxpolkit_dim_pixels(gdk_pixbuf_get_pixels(pixbuf),
+                        gdk_pixbuf_get_width(pixbuf),
+                        gdk_pixbuf_get_height(pixbuf),
+                        gdk_pixbuf_get_rowstride(pixbuf),
+                        gdk_pixbuf_get_n_channels(pixbuf));
+
+    surface = backdrop_upload(root, area->width, area->height, &cr);
+    gdk_cairo_set_source_pixbuf(cr, pixbuf, 0, 0);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    g_object_unref(pixbuf);
+    return surface;
+}
+
+/* Let the X server shrink the monitor into a pixmap 1/scale of its size,
+ * so memory and time follow the output size and the full resolution pixels
+ * never reach the client. */
+static cairo_surface_t* backdrop_grab_scaled(GdkScreen* screen, const GdkRectangle* area, int scale, cairo_filter_t filter)
+{
+    GdkWindow* root = gdk_screen_get_root_window(screen);
+    cairo_surface_t* surface;
+    cairo_t* cr;
+
+    surface = backdrop_upload(root, MAX(area->width / scale, 1), MAX(area->height / scale, 1), &cr);
+    cairo_scale(cr, 1.0 / scale, 1.0 / scale);
+    gdk_cairo_set_source_window(cr, root, -area->x, -area->y);
+    cairo_pattern_set_filter(cairo_get_source(cr), filter);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    return surface;
+}
+
+/* Darken a grabbed surface on the server. */
+static void backdrop_darken(cairo_surface_t* surface)
+{
+    cairo_t* cr = cairo_create(surface);
+    cairo_set_source_rgba(cr, 0, 0, 0, LXPOLKIT_BACKDROP_OVERLAY_ALPHA);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+}
+
+/* Frosted glass: blur and darken a small grab on the client. The grab is
+ * point sampled, which the blur hides, so the server only reads every
+ * BACKDROP_BLUR_SCALE-th pixel of every BACKDROP_BLUR_SCALE-th row; blurring
+ * that stays cheaper than darkening the full capture, and the paint path
+ * scales it back up. */
+static void backdrop_frost(cairo_surface_t* surface)
+{
+    cairo_surface_t* image = cairo_surface_map_to_image(surface, NULL);
+    gboolean ok = (cairo_image_surface_get_format(image) == CAIRO_FORMAT_RGB24);
+
+    if(ok) {
+        guchar* pixels = cairo_image_surface_get_data(image);
+        int width = cairo_image_surface_get_width(image);
+        int height = cairo_image_surface_get_height(image);
+        int stride = cairo_image_surface_get_stride(image);
+        cairo_surface_flush(image);
+        lxpolkit_blur_pixels(pixels, width, height, stride, BACKDROP_BLUR_RADIUS, BACKDROP_BLUR_PASSES);
+        lxpolkit_dim_pixels(pixels, width * 4, height, stride, 1);
+        cairo_surface_mark_dirty(image);
+    }
+    cairo_surface_unmap_image(surface, image);
+    if(!ok)
+        backdrop_darken(surface);
+}
+
+/* Setting LXPOLKIT_CAPTURE=gdk skips MIT-SHM, e.g. to compare both paths under Xvfb. */
+static cairo_surface_t* backdrop_capture(GdkScreen* screen, int monitor, int scale, gboolean blur)
+{
+    BackdropGeometry* geometry = g_new(BackdropGeometry, 1);
+    cairo_surface_t* surface = NULL;
+
+    if(blur)
+        scale = MAX(scale, BACKDROP_BLUR_SCALE);
+    gdk_screen_get_monitor_geometry(screen, monitor, &geometry->area);
+    geometry->scale = scale;
+    geometry->x = geometry->area.x;
+    geometry->y = geometry->area.y;
+
+    if(blur) {
+        surface = backdrop_grab_scaled(screen, &geometry->area, scale, CAIRO_FILTER_FAST);
+        backdrop_frost(surface);
+    }
+    else if(scale > 1) {
+        surface = backdrop_grab_scaled(screen, &geometry->area, scale, CAIRO_FILTER_GOOD);
+        backdrop_darken(surface);
+    }
+#ifdef HAVE_XSHM
+    if(!surface && GDK_IS_X11_SCREEN(screen) && g_strcmp0(g_getenv("LXPOLKIT_CAPTURE"), "gdk") != 0)
+        surface = backdrop_capture_shm(screen, &geometry->area);
+#endif
+    if(!surface)
+        surface = backdrop_capture_pixbuf(screen, &geometry->area);
+
+    if(surface)
+        cairo_surface_set_user_data(surface, &geometry_key, geometry, g_free);
+    else
+        g_free(geometry);
+    return surface;
+}
+
+cairo_surface_t* lxpolkit_backdrop_get_surface(LXPolkitBackdrop* backdrop, int monitor)
+{
+    gint64 now = g_get_monotonic_time();
+
+    backdrop_ensure_screen(backdrop);
+
+    if(backdrop->surface && (now - backdrop->captured > BACKDROP_MAX_AGE || monitor != backdrop->monitor))
+        lxpolkit_backdrop_invalidate(backdrop);
+
+    if(!backdrop->surface) {
+        backdrop->surface = backdrop_capture(backdrop->screen, monitor, backdrop->scale, backdrop->blur);
+        lxpolkit_stats_backdrop_captured(g_get_monotonic_time() - now);
+        backdrop->captured = now;
+        backdrop->monitor = monitor;
+        DEBUG("backdrop captured for monitor %d at 1/%d size%s", monitor, backdrop->scale, backdrop->blur ? ", blurred" : "");
+    }
+    else
+        DEBUG("backdrop reused");
+    return backdrop->surface;
+}
+
+int lxpolkit_backdrop_get_monitor(LXPolkitBackdrop* backdrop)
+{
+    GdkDevice* pointer;
+    GdkScreen* screen = NULL;
+    int x, y;
+
+    backdrop_ensure_screen(backdrop);
+    pointer = gdk_seat_get_pointer(gdk_display_get_default_seat(gdk_screen_get_display(backdrop->screen)));
+    if(pointer)
+        gdk_device_get_position(pointer, &screen, &x, &y);
+    if(screen != backdrop->screen)
+        return gdk_screen_get_primary_monitor(backdrop->screen);
+    return gdk_screen_get_monitor_at_point(backdrop->screen, x, y);
+}
+
+void lxpolkit_backdrop_paint(cairo_t* cr, GtkWidget* widget, cairo_surface_t* surface)
+{
+    BackdropGeometry* geometry = surface ? cairo_surface_get_user_data(surface, &geometry_key) : NULL;
+    GdkRectangle clip;
+
+    if(!gdk_cairo_get_clip_rectangle(cr, &clip))
+        return;
+
+    cairo_save(cr);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    /* Without a capture the window gets a plain fill: translucent on an
+     * RGBA visual, dark otherwise. */
+    cairo_set_source_rgba(cr, 0, 0, 0, LXPOLKIT_BACKDROP_OVERLAY_ALPHA);
+    if(geometry) {
+        /* the origin was stored when the window was placed; asking the
+         * server here would be a round trip on every expose */
+        cairo_translate(cr, geometry->area.x - geometry->x, geometry->area.y - geometry->y);
+        cairo_scale(cr, geometry->scale, geometry->scale);
+        cairo_set_source_surface(cr, surface, 0, 0);
+        if(geometry->scale > 1)
+            cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_BILINEAR);
+    }
+    cairo_paint(cr);
+    cairo_restore(cr);
+}
+
+void lxpolkit_backdrop_set_origin(cairo_surface_t* surface, int x, int y)
+{
+    BackdropGeometry* geometry = cairo_surface_get_user_data(surface, &geometry_key);
+    if(geometry) {
+        geometry->x = x;
+        geometry->y = y;
+    }
+}
+
+gboolean lxpolkit_backdrop_use_overlay(LXPolkitBackdrop* backdrop)
+{
+    gboolean overlay;
+
+    backdrop_ensure_screen(backdrop);
+    overlay = gdk_screen_is_composited(backdrop->screen) &&
+              gdk_screen_get_rgba_visual(backdrop->screen) != NULL;
+    if(backdrop->overlay != overlay) {
+        DEBUG("backdrop: %s", overlay ? "translucent overlay (compositing manager running)" : "dimmed screen capture");
+        backdrop->overlay = overlay;
+    }
+    /* a capture taken before the compositor started is of no use any more. */
+    if(overlay)
+        lxpolkit_backdrop_invalidate(backdrop);
+    return overlay;
+}
@@ -0,0 +1,74 @@
+/*
+ *      lxpolkit-backdrop.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_BACKDROP_H__
+#define __LXPOLKIT_BACKDROP_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/* Cache of the dimmed root window capture shown behind the dialog. */
+typedef struct _LXPolkitBackdrop LXPolkitBackdrop;
+
+LXPolkitBackdrop* lxpolkit_backdrop_new(void);
+void lxpolkit_backdrop_free(LXPolkitBackdrop* backdrop);
+
+/* Capture screen instead of the default screen. Call before first use. */
+void lxpolkit_backdrop_set_screen(LXPolkitBackdrop* backdrop, GdkScreen* screen);
+
+/* Returns the cached backdrop of the given monitor, capturing it again if
+ * the cache is empty, stale or of another monitor. The surface is owned by
+ * the cache; take a reference to keep it past the next call. May return NULL. */
+cairo_surface_t* lxpolkit_backdrop_get_surface(LXPolkitBackdrop* backdrop, int monitor);
+
+/* The monitor holding the pointer, or the primary one. */
+int lxpolkit_backdrop_get_monitor(LXPolkitBackdrop* backdrop);
+
+/* Capture at 1/scale of the monitor resolution and scale up when painting.
+ * 1, the default, captures at full resolution. */
+void lxpolkit_backdrop_set_scale(LXPolkitBackdrop* backdrop, int scale);
+
+/* Show a blurred, darkened backdrop instead of only darkening it. */
+void lxpolkit_backdrop_set_blur(LXPolkitBackdrop* backdrop, gboolean blur);
+
+/* Paint the backdrop into the clip region of widget, a toplevel window.
+ * A NULL surface paints the translucent overlay. */
+void lxpolkit_backdrop_paint(cairo_t* cr, GtkWidget* widget, cairo_surface_t* surface);
+
+/* Where the window painting surface is placed, in root window coordinates.
+ * Call when placing the window; until then it is assumed to cover the
+ * captured monitor exactly. */
+void lxpolkit_backdrop_set_origin(cairo_surface_t* surface, int x, int y);
+
+/* Drop the cached capture. */
+void lxpolkit_backdrop_invalidate(LXPolkitBackdrop* backdrop);
+
+/* Alpha of the black fill that replaces the capture in overlay mode. It
+ * matches the 2/5 brightness of the dimmed capture. */
+#define LXPOLKIT_BACKDROP_OVERLAY_ALPHA     0.6
+
+/* Whether a compositing manager is running and the dialog can use an RGBA
+ * visual with a translucent fill instead of a screen capture. */
+gboolean lxpolkit_backdrop_use_overlay(LXPolkitBackdrop* backdrop);
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_BACKDROP_H__ */
@@ -0,0 +1,481 @@
+/*
+ *      lxpolkit-bench.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/* Microbenchmarks of the hot paths, run with "make bench".
+ *
+ * The frosted backdrop must not cost more than the flat darken of a full
+ * capture. Its point sampled downscale normally happens in the X server;
+ * here it is done on the client too, so the budget holds even when the
+ * server shares the same slow CPU.
+ *
+ * Given the path of lxpolkit.ui and a display, it also compares building
+ * and realizing the authentication dialog from that file and from the
+ * embedded resource with resetting a pooled one, and fills identity lists
+ * of growing length into it. Given the path of xml-purge, it purges large
+ * generated UI files with it.
+ *
+ * Every result is the median of its runs, with the malloc(), calloc() and
+ * realloc() calls and bytes per run where glibc lets them be counted. With
+ * --json each result is printed as one JSON object per line, so results of
+ * different releases can be compared by a script. The inputs are generated
+ * from a fixed seed, so runs on one machine are comparable. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include "lxpolkit-blur.h"
+#include "lxpolkit-dialog.h"
+#include "lxpolkit-dim.h"
+
+#define BENCH_RUNS      15
+#define PURGE_RUNS      5
+#define BLUR_SCALE      8
+#define BLUR_RADIUS     2
+#define BLUR_PASSES     3
+#define SPINNER_SIZE    32
+#define PURGE_SIZE      (32 * 1024 * 1024)
+
+static char* ui_file = NULL;
+static char* xml_purge = NULL;
+static gboolean json = FALSE;
+
+static GOptionEntry option_entries[] =
+{
+    { "ui", 0, 0, G_OPTION_ARG_FILENAME, &ui_file, "Benchmark the dialog built from FILE, needs a display", "FILE" },
+    { "xml-purge", 0, 0, G_OPTION_ARG_FILENAME, &xml_purge, "Benchmark the xml-purge program at PATH", "PATH" },
+    { "json", 0, 0, G_OPTION_ARG_NONE, &json, "Print one JSON object per result", NULL },
+    { NULL }
+};
+
+#ifdef __GLIBC__
+/* Count the allocations of the whole process, worker threads included, by
+ * interposing the allocator of glibc. */
+#define ALLOC_COUNTING
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static guint alloc_calls;
+static guint64 alloc_bytes;
+
+static inline void count_alloc(size_t size)
+{
+    __atomic_fetch_add(&alloc_calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+}
+
+void* malloc(size_t size)
+{
+    count_alloc(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size)
+{
+    count_alloc(n * size);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    count_alloc(size);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+typedef struct _BenchResult BenchResult;
+struct _BenchResult
+{
+    gint64 samples[BENCH_RUNS];
+    int runs;
+    gboolean counted;           /* whether the allocations were counted */
+    guint64 calls;              /* summed over all runs */
+    guint64 bytes;
+    gint64 start;
+    guint calls_start;
+    guint64 bytes_start;
+};
+
+static void run_begin(BenchResult* r)
+{
+#ifdef ALLOC_COUNTING
+    r->counted = TRUE;
+    r->calls_start = __atomic_load_n(&alloc_calls, __ATOMIC_SEQ_CST);
+    r->bytes_start = __atomic_load_n(&alloc_bytes, __ATOMIC_SEQ_CST);
+#endif
+    r->start = g_get_monotonic_time();
+}
+
+static void run_end(BenchResult* r)
+{
+    r->samples[r->runs++] = g_get_monotonic_time() - r->start;
+#ifdef ALLOC_COUNTING
+    r->calls += __atomic_load_n(&alloc_calls, __ATOMIC_SEQ_CST) - r->calls_start;
+    r->bytes += __atomic_load_n(&alloc_bytes, __ATOMIC_SEQ_CST) - r->bytes_start;
+#endif
+}
+
+static int compare_gint64(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64*)a, y = *(const gint64*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* The first run is kept: it may include a disk read or a cache fill. */
+static gint64 median(BenchResult* r, gint64* first)
+{
+    gint64 sorted[BENCH_RUNS];
+    *first = r->samples[0];
+    memcpy(sorted, r->samples, r->runs * sizeof(gint64));
+    qsort(sorted, r->runs, sizeof(gint64), compare_gint64);
+    return sorted[r->runs / 2];
+}
+
+static void report(const char* name, BenchResult* r)
+{
+    gint64 first, med = median(r, &first);
+    if(json) {
+        printf("{\"name\":\"%s\",\"runs\":%d,\"median_us\":%" G_GINT64_FORMAT ",\"first_us\":%" G_GINT64_FORMAT,
+               name, r->runs, med, first);
+        if(r->counted)
+            printf(",\"allocs\":%" G_GUINT64_FORMAT ",\"alloc_bytes\":%" G_GUINT64_FORMAT "}\n",
+                   r->calls / r->runs, r->bytes / r->runs);
+        else
+            printf(",\"allocs\":null,\"alloc_bytes\":null}\n");
+    } else if(r->counted)
+        printf("%-26s %9.2f ms  first %9.2f ms  %8" G_GUINT64_FORMAT " allocs  %11" G_GUINT64_FORMAT " bytes\n",
+               name, med / 1000.0, first / 1000.0, r->calls / r->runs, r->bytes / r->runs);
+    else
+        printf("%-26s %9.2f ms  first %9.2f ms\n", name, med / 1000.0, first / 1000.0);
+}
+
+static void report_budget(const char* name, gboolean within)
+{
+    if(json)
+        printf("{\"name\":\"%s\",\"within_budget\":%s}\n", name, within ? "true" : "false");
+    else
+        printf("%-26s %s\n", name, within ? "within budget" : "OVER BUDGET");
+}
+
+static void fill(guchar* pixels, gsize n_bytes)
+{
+    gsize i;
+    guint32 seed = 12345;
+    for(i = 0; i < n_bytes; ++i) {
+        seed = seed * 1103515245 + 12345;
+        pixels[i] = (guchar)(seed >> 16);
+    }
+}
+
+/* 4 byte per pixel point sampled downscale by scale. */
+static void downsample(const guchar* src, int width, int height, guchar* dst, int scale)
+{
+    int dw = width / scale, dh = height / scale, x, y;
+    for(y = 0; y < dh; ++y) {
+        const guint32* row = (const guint32*)(src + (gsize)y * scale * width * 4);
+        guint32* out = (guint32*)(dst + (gsize)y * dw * 4);
+        for(x = 0; x < dw; ++x)
+            out[x] = row[x * scale];
+    }
+}
+
+/* Darken a capture with 3 (a GdkPixbuf of the root window) or 4 (an X
+ * image) channels. */
+static gint64 bench_dim(const char* name, int width, int height, int n_channels)
+{
+    int rowstride = (width * n_channels + 3) & ~3;
+    gsize n_bytes = (gsize)rowstride * height;
+    guchar* pixels = g_malloc(n_bytes);
+    BenchResult r = { { 0 } };
+    gint64 first;
+
+    while(r.runs < BENCH_RUNS) {
+        fill(pixels, n_bytes);
+        run_begin(&r);
+        lxpolkit_dim_pixels(pixels, width, height, rowstride, n_channels);
+        run_end(&r);
+    }
+    g_free(pixels);
+    report(name, &r);
+    return median(&r, &first);
+}
+
+static gint64 bench_blur(const char* name, int width, int height)
+{
+    gsize n_bytes = (gsize)width * height * 4;
+    int dw = width / BLUR_SCALE, dh = height / BLUR_SCALE;
+    guchar* pixels = g_malloc(n_bytes);
+    guchar* small = g_malloc((gsize)dw * dh * 4);
+    BenchResult r = { { 0 } };
+    gint64 first;
+
+    while(r.runs < BENCH_RUNS) {
+        fill(pixels, n_bytes);
+        run_begin(&r);
+        downsample(pixels, width, height, small, BLUR_SCALE);
+        lxpolkit_blur_pixels(small, dw, dh, dw * 4, BLUR_RADIUS, BLUR_PASSES);
+        lxpolkit_dim_pixels(small, dw * 4, dh, dw * 4, 1);
+        run_end(&r);
+    }
+    g_free(small);
+    g_free(pixels);
+    report(name, &r);
+    return median(&r, &first);
+}
+
+/* What draw() does for a damaged area of a window over a monitor: paint
+ * the backdrop, captured at 1/scale size, into the clip with the source
+ * operator. */
+static void bench_paint(const char* name, int width, int height, int scale, int clip_width, int clip_height)
+{
+    cairo_surface_t* target = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+    cairo_surface_t* backdrop = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width / scale, height / scale);
+    BenchResult r = { { 0 } };
+
+    cairo_surface_flush(backdrop);
+    fill(cairo_image_surface_get_data(backdrop),
+         (gsize)cairo_image_surface_get_stride(backdrop) * cairo_image_surface_get_height(backdrop));
+    cairo_surface_mark_dirty(backdrop);
+    while(r.runs < BENCH_RUNS) {
+        cairo_t* cr;
+        run_begin(&r);
+        cr = cairo_create(target);
+        cairo_rectangle(cr, (width - clip_width) / 2, (height - clip_height) / 2, clip_width, clip_height);
+        cairo_clip(cr);
+        cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+        cairo_scale(cr, scale, scale);
+        cairo_set_source_surface(cr, backdrop, 0, 0);
+        if(scale > 1)
+            cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_BILINEAR);
+        cairo_paint(cr);
+        cairo_destroy(cr);
+        cairo_surface_flush(target);
+        run_end(&r);
+    }
+    cairo_surface_destroy(backdrop);
+    cairo_surface_destroy(target);
+    report(name, &r);
+}
+
+/* Build and realize a dialog from ui_file, or from the embedded resource if
+ * it is NULL. The first build includes reading the file, which is a disk
+ * access on a cold page cache. */
+static gboolean bench_dialog_build(const char* name, const char* ui_file)
+{
+    BenchResult r = { { 0 } };
+
+    while(r.runs < BENCH_RUNS) {
+        LXPolkitDialog* dialog;
+        run_begin(&r);
+        dialog = lxpolkit_dialog_new(ui_file, NULL);
+        if(!dialog)
+            return FALSE;
+        gtk_widget_realize(dialog->dlg);
+        run_end(&r);
+        lxpolkit_dialog_free(dialog);
+    }
+    report(name, &r);
+    return TRUE;
+}
+
+static void bench_dialog_reuse(const char* name, LXPolkitDialog* dialog)
+{
+    BenchResult r = { { 0 } };
+
+    while(r.runs < BENCH_RUNS) {
+        run_begin(&r);
+        lxpolkit_dialog_reset(dialog);
+        gtk_widget_realize(dialog->dlg);
+        run_end(&r);
+    }
+    report(name, &r);
+}
+
+/* Fill n identities into a store and give it to the dialog, the combo box
+ * for short lists and the search entry for long ones, as show_request()
+ * does. The agent adds long lists a chunk at a time from the main loop;
+ * here they are added at once. */
+static void bench_identities(const char* name, LXPolkitDialog* dialog, int n)
+{
+    GPtrArray* ids = g_ptr_array_new_with_free_func(g_object_unref);
+    GtkEntryCompletion* completion = gtk_entry_get_completion(GTK_ENTRY(dialog->id_search));
+    BenchResult r = { { 0 } };
+    int i;
+
+    for(i = 0; i < n; ++i)
+        g_ptr_array_add(ids, g_object_new(G_TYPE_OBJECT, NULL));
+    while(r.runs < BENCH_RUNS) {
+        GtkListStore* store;
+        lxpolkit_dialog_reset(dialog);
+        run_begin(&r);
+        store = gtk_list_store_new(2, G_TYPE_STRING, G_TYPE_OBJECT);
+        for(i = 0; i < n; ++i) {
+            char* label = g_strdup_printf("User %d (user%d)", i, i);
+            gtk_list_store_insert_with_values(store, NULL, -1, 0, label, 1, g_ptr_array_index(ids, i), -1);
+            g_free(label);
+        }
+        if(n <= LXPOLKIT_DIALOG_COMBO_MAX) {
+            gtk_combo_box_set_model(GTK_COMBO_BOX(dialog->id), GTK_TREE_MODEL(store));
+            gtk_combo_box_set_active(GTK_COMBO_BOX(dialog->id), 0);
+        } else
+            gtk_entry_completion_set_model(completion, GTK_TREE_MODEL(store));
+        run_end(&r);
+        g_object_unref(store);
+    }
+    lxpolkit_dialog_reset(dialog);
+    g_ptr_array_free(ids, TRUE);
+    report(name, &r);
+}
+
+/* A UI file of about size bytes, indented and commented like a
+ * hand-edited one. */
+static GString* make_ui(gsize size)
+{
+    GString* ui = g_string_new("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<interface>\n");
+    int i;
+    for(i = 0; ui->len < size; ++i)
+        g_string_append_printf(ui,
+            "  <!-- label %d -->\n"
+            "  <object class=\"GtkLabel\" id=\"label%d\">\n"
+            "    <property name=\"visible\">True</property>\n"
+            "    <property name=\"label\" translatable=\"yes\">Label   number %d</property>\n"
+            "    <style>\n"
+            "      <class name=\"dim-label\"/>\n"
+            "    </style>\n"
+            "  </object>\n", i, i, i);
+    g_string_append(ui, "</interface>\n");
+    return ui;
+}
+
+/* Purge n_files generated files that add up to PURGE_SIZE with a single
+ * run of xml-purge, process start included. The allocations are those of
+ * another process and are not counted. */
+static gboolean bench_purge(const char* name, int n_files)
+{
+    GString* ui = make_ui(PURGE_SIZE / n_files);
+    char** argv = g_new0(char*, n_files + 2);
+    BenchResult r = { { 0 } };
+    gboolean ok = TRUE;
+    int i, status;
+
+    argv[0] = g_strdup(xml_purge);
+    for(i = 0; i < n_files; ++i)
+        argv[i + 1] = g_strdup_printf("%s/lxpolkit-bench-%d-%d.ui", g_get_tmp_dir(), (int)getpid(), i);
+    while(ok && r.runs < PURGE_RUNS) {
+        for(i = 0; ok && i < n_files; ++i)
+            ok = g_file_set_contents(argv[i + 1], ui->str, ui->len, NULL);
+        if(!ok)
+            break;
+        r.start = g_get_monotonic_time();
+        ok = g_spawn_sync(NULL, argv, NULL, G_SPAWN_STDOUT_TO_DEV_NULL, NULL, NULL, NULL, NULL, &status, NULL)
+             && g_spawn_check_exit_status(status, NULL);
+        r.samples[r.runs++] = g_get_monotonic_time() - r.start;
+    }
+    for(i = 0; i < n_files; ++i)
+        g_unlink(argv[i + 1]);
+    g_strfreev(argv);
+    g_string_free(ui, TRUE);
+    if(ok)
+        report(name, &r);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    static const struct { const char* name; int width, height; } sizes[] = {
+        { "1080p", 1920, 1080 },
+        { "1440p", 2560, 1440 },
+        { "4K", 3840, 2160 },
+    };
+    static const int identity_counts[] = { 10, 100, 1000 };
+    GOptionContext* context;
+    GError* err = NULL;
+    gboolean ok = TRUE;
+    char name[64];
+    guint i;
+
+    context = g_option_context_new("");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+    if(!g_option_context_parse(context, &argc, &argv, &err)) {
+        g_printerr("Error: %s\n", err->message);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    if(!json)
+        printf("dim kernel: %s\n", lxpolkit_dim_get_impl_name());
+    for(i = 0; i < G_N_ELEMENTS(sizes); ++i) {
+        int width = sizes[i].width, height = sizes[i].height;
+        gint64 dim, blur;
+        g_snprintf(name, sizeof(name), "dim/%s/rgb", sizes[i].name);
+        bench_dim(name, width, height, 3);
+        g_snprintf(name, sizeof(name), "dim/%s/rgba", sizes[i].name);
+        dim = bench_dim(name, width, height, 4);
+        g_snprintf(name, sizeof(name), "frosted/%s", sizes[i].name);
+        blur = bench_blur(name, width, height);
+        g_snprintf(name, sizeof(name), "frosted/%s/budget", sizes[i].name);
+        report_budget(name, blur <= dim);
+        ok = ok && blur <= dim;
+
+        g_snprintf(name, sizeof(name), "paint/%s/full", sizes[i].name);
+        bench_paint(name, width, height, 1, width, height);
+        g_snprintf(name, sizeof(name), "paint/%s/spinner", sizes[i].name);
+        bench_paint(name, width, height, 1, SPINNER_SIZE, SPINNER_SIZE);
+        g_snprintf(name, sizeof(name), "paint/%s/frosted", sizes[i].name);
+        bench_paint(name, width, height, BLUR_SCALE, width, height);
+    }
+
+    if(ui_file) {
+        if(gtk_init_check(NULL, NULL)) {
+            /* The file is loaded first so that a page cache dropped before
+             * the run (echo 3 > /proc/sys/vm/drop_caches) shows in its first
+             * build, like the startup of an agent reading an installed file. */
+            LXPolkitDialog* dialog;
+            if(!bench_dialog_build("dialog/file", ui_file) || !bench_dialog_build("dialog/resource", NULL)
+               || !(dialog = lxpolkit_dialog_new(NULL, NULL))) {
+                g_printerr("dialog cannot load %s\n", ui_file);
+                ok = FALSE;
+            } else {
+                gtk_widget_realize(dialog->dlg);
+                bench_dialog_reuse("dialog/reuse", dialog);
+                for(i = 0; i < G_N_ELEMENTS(identity_counts); ++i) {
+                    g_snprintf(name, sizeof(name), "identities/%d", identity_counts[i]);
+                    bench_identities(name, dialog, identity_counts[i]);
+                }
+                lxpolkit_dialog_free(dialog);
+            }
+        } else
+            g_printerr("dialog skipped, no display\n");
+    }
+
+    if(xml_purge) {
+        if(!bench_purge("xml-purge/1x32M", 1) || !bench_purge("xml-purge/4x8M", 4)) {
+            g_printerr("%s failed\n", xml_purge);
+            ok = FALSE;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,222 @@
+/*
+ *      lxpolkit-blur.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-blur.h"
+#include "lxpolkit-parallel.h"
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define BLUR_HAVE_SSE2 1
+#elif defined(__GNUC__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BLUR_HAVE_NEON 1
+#endif
+
+/* Running box sums with edge pixels repeated, kept in 16 bits, which holds
+ * n = 2 * radius + 1 <= 257 bytes. Averages are (sum * mul) >> 16 with
+ * mul = 65536 / n rounded up, a plain high half multiply in SIMD. Rounding
+ * up adds less than 255 * n / 65536 < 1 to the result, so the average of
+ * bytes never exceeds 255 and fits the byte it is packed into; radius >= 1
+ * keeps mul <= 21846 in 16 bits. SSE2 and NEON are baseline on
+ * the CPUs that have them, so unlike the dim kernels they are picked at
+ * compile time. */
+#define BLUR_MAX_RADIUS     128
+
+typedef struct _BlurJob BlurJob;
+struct _BlurJob
+{
+    guchar* src;
+    int src_stride;
+    guchar* dst;
+    int dst_stride;
+    int width;
+    int height;
+    int radius;
+    guint16 mul;
+};
+
+#define BLUR_AVG(sum, mul)  ((guchar)(((guint32)(sum) * (mul)) >> 16))
+
+/* Horizontal pass over rows [y0, y1), one 4 channel pixel at a time. */
+static void blur_rows(int y0, int y1, gpointer user_data)
+{
+    BlurJob* job = (BlurJob*)user_data;
+    int last = job->width - 1, r = job->radius;
+    int y, x, i;
+
+    for(y = y0; y < y1; ++y) {
+        const guchar* src = job->src + (gsize)y * job->src_stride;
+        guchar* dst = job->dst + (gsize)y * job->dst_stride;
+#if defined(BLUR_HAVE_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i mul = _mm_set1_epi16((short)job->mul);
+        guint32 px;
+        __m128i sum;
+#define LOAD_PX(p)  (memcpy(&px, (p), 4), _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)px), zero))
+        sum = _mm_mullo_epi16(LOAD_PX(src), _mm_set1_epi16((short)(r + 1)));
+        for(i = 1; i <= r; ++i)
+            sum = _mm_add_epi16(sum, LOAD_PX(src + MIN(i, last) * 4));
+        for(x = 0; x <= last; ++x) {
+            px = (guint32)_mm_cvtsi128_si32(_mm_packus_epi16(_mm_mulhi_epu16(sum, mul), zero));
+            memcpy(dst + x * 4, &px, 4);
+            sum = _mm_add_epi16(sum, LOAD_PX(src + MIN(x + r + 1, last) * 4));
+            sum = _mm_sub_epi16(sum, LOAD_PX(src + MAX(x - r, 0) * 4));
+        }
+#undef LOAD_PX
+#elif defined(BLUR_HAVE_NEON)
+        const uint16x4_t mul = vdup_n_u16(job->mul);
+        guint32 px;
+        uint16x4_t sum;
+#define LOAD_PX(p)  (memcpy(&px, (p), 4), vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(px)))))
+        sum = vmul_n_u16(LOAD_PX(src), (guint16)(r + 1));
+        for(i = 1; i <= r; ++i)
+            sum = vadd_u16(sum, LOAD_PX(src + MIN(i, last) * 4));
+        for(x = 0; x <= last; ++x) {
+            uint16x4_t avg = vshrn_n_u32(vmull_u16(sum, mul), 16);
+            px = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(avg, avg))), 0);
+            memcpy(dst + x * 4, &px, 4);
+            sum = vadd_u16(sum, LOAD_PX(src + MIN(x + r + 1, last) * 4));
+            sum = vsub_u16(sum, LOAD_PX(src + MAX(x - r, 0) * 4));
+        }
+#undef LOAD_PX
+#else
+        guint16 sum[4];
+        int c;
+        for(c = 0; c < 4; ++c) {
+            sum[c] = (r + 1) * src[c];
+            for(i = 1; i <= r; ++i)
+                sum[c] += src[MIN(i, last) * 4 + c];
+        }
+        for(x = 0; x <= last; ++x) {
+            const guchar* add = src + MIN(x + r + 1, last) * 4;
+            const guchar* sub = src + MAX(x - r, 0) * 4;
+            for(c = 0; c < 4; ++c) {
+                dst[x * 4 + c] = BLUR_AVG(sum[c], job->mul);
+                sum[c] += add[c] - sub[c];
+            }
+        }
+#endif
+    }
+}
+
+/* Output one row of the vertical pass and slide the column sums by a row. */
+static void blur_column_step(guint16* acc, const guchar* add, const guchar* sub, guchar* dst, int n, guint16 mul)
+{
+    int i = 0;
+#if defined(BLUR_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i m = _mm_set1_epi16((short)mul);
+    for(; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(add + i));
+        __m128i s = _mm_loadu_si128((const __m128i*)(sub + i));
+        __m128i lo = _mm_loadu_si128((const __m128i*)(acc + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(acc + i + 8));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(_mm_mulhi_epu16(lo, m), _mm_mulhi_epu16(hi, m)));
+        lo = _mm_sub_epi16(_mm_add_epi16(lo, _mm_unpacklo_epi8(a, zero)), _mm_unpacklo_epi8(s, zero));
+        hi = _mm_sub_epi16(_mm_add_epi16(hi, _mm_unpackhi_epi8(a, zero)), _mm_unpackhi_epi8(s, zero));
+        _mm_storeu_si128((__m128i*)(acc + i), lo);
+        _mm_storeu_si128((__m128i*)(acc + i + 8), hi);
+    }
+#elif defined(BLUR_HAVE_NEON)
+    const uint16x4_t m = vdup_n_u16(mul);
+    for(; i + 16 <= n; i += 16) {
+        uint8x16_t a = vld1q_u8(add + i);
+        uint8x16_t s = vld1q_u8(sub + i);
+        uint16x8_t lo = vld1q_u16(acc + i);
+        uint16x8_t hi = vld1q_u16(acc + i + 8);
+        uint16x8_t avg_lo = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(lo), m), 16),
+                                         vshrn_n_u32(vmull_u16(vget_high_u16(lo), m), 16));
+        uint16x8_t avg_hi = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(hi), m), 16),
+                                         vshrn_n_u32(vmull_u16(vget_high_u16(hi), m), 16));
+        vst1q_u8(dst + i, vcombine_u8(vmovn_u16(avg_lo), vmovn_u16(avg_hi)));
+        vst1q_u16(acc + i, vsubq_u16(vaddw_u8(lo, vget_low_u8(a)), vmovl_u8(vget_low_u8(s))));
+        vst1q_u16(acc + i + 8, vsubq_u16(vaddw_u8(hi, vget_high_u8(a)), vmovl_u8(vget_high_u8(s))));
+    }
+#endif
+    for(; i < n; ++i) {
+        dst[i] = BLUR_AVG(acc[i], mul);
+        acc[i] += add[i] - sub[i];
+    }
+}
+
+/* Vertical pass over the byte columns [x0, x1), a whole row of the range at a time. */
+static void blur_columns(int x0, int x1, gpointer user_data)
+{
+    BlurJob* job = (BlurJob*)user_data;
+    int last = job->height - 1, r = job->radius, n = x1 - x0;
+    guint16* acc = g_new(guint16, n);
+    int y, i, k;
+
+#define ROW(b, stride, y)   ((b) + (gsize)(y) * (stride) + x0)
+    {
+        const guchar* first = ROW(job->src, job->src_stride, 0);
+        for(i = 0; i < n; ++i)
+            acc[i] = (r + 1) * first[i];
+        for(k = 1; k <= r; ++k) {
+            const guchar* row = ROW(job->src, job->src_stride, MIN(k, last));
+            for(i = 0; i < n; ++i)
+                acc[i] += row[i];
+        }
+    }
+    for(y = 0; y <= last; ++y)
+        blur_column_step(acc,
+                         ROW(job->src, job->src_stride, MIN(y + r + 1, last)),
+                         ROW(job->src, job->src_stride, MAX(y - r, 0)),
+                         ROW(job->dst, job->dst_stride, y),
+                         n, job->mul);
+#undef ROW
+    g_free(acc);
+}
+
+void lxpolkit_blur_pixels(guchar* pixels, int width, int height, int rowstride, int radius, int passes)
+{
+    BlurJob job;
+    guchar* tmp;
+    gsize cost = (gsize)width * height * 4;
+    int pass;
+
+    if(!pixels || width <= 0 || height <= 0 || radius <= 0)
+        return;
+    radius = MIN(radius, BLUR_MAX_RADIUS);
+
+    tmp = g_malloc(cost);
+    job.width = width;
+    job.height = height;
+    job.radius = radius;
+    job.mul = (guint16)((65536 + 2 * radius) / (2 * radius + 1));
+    for(pass = 0; pass < passes; ++pass) {
+        job.src = pixels;
+        job.src_stride = rowstride;
+        job.dst = tmp;
+        job.dst_stride = width * 4;
+        lxpolkit_parallel_for(height, cost, blur_rows, &job);
+
+        job.src = tmp;
+        job.src_stride = width * 4;
+        job.dst = pixels;
+        job.dst_stride = rowstride;
+        lxpolkit_parallel_for(width * 4, cost, blur_columns, &job);
+    }
+    g_free(tmp);
+}
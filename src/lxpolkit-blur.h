@@ -0,0 +1,34 @@
+/*
+ *      lxpolkit-blur.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_BLUR_H__
+#define __LXPOLKIT_BLUR_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Blur 4 byte per pixel data in place with separable box blurs of the given
+ * radius, repeated passes times. Three passes approximate a Gaussian. */
+void lxpolkit_blur_pixels(guchar* pixels, int width, int height, int rowstride, int radius, int passes);
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_BLUR_H__ */
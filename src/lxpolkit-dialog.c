@@ -0,0 +1,183 @@
+/*
+ *      lxpolkit-dialog.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-dialog.h"
+#include "lxpolkit-icons.h"
+#include <glib/gi18n.h>
+#include <string.h>
+
+#ifdef G_ENABLE_DEBUG
+#define DEBUG(...)  g_debug(__VA_ARGS__)
+#else
+#define DEBUG(...)
+#endif
+
+#define DIALOG_ICON     "dialog-password-symbolic"
+
+/* text normalized and case folded the way GtkEntryCompletion does with
+ * the key it matches, or NULL if it is not valid UTF-8 */
+static char* fold_name(const char* text)
+{
+    char* normalized = text ? g_utf8_normalize(text, -1, G_NORMALIZE_ALL) : NULL;
+    char* folded = NULL;
+    if(normalized) {
+        folded = g_utf8_casefold(normalized, -1);
+        g_free(normalized);
+    }
+    return folded;
+}
+
+/* Identities whose name contains the typed text, in any case. key comes
+ * normalized and case folded. */
+static gboolean match_identity(GtkEntryCompletion* completion, const char* key,
+                               GtkTreeIter* it, gpointer unused)
+{
+    GtkTreeModel* model = gtk_entry_completion_get_model(completion);
+    gboolean match = FALSE;
+    char* name;
+    char* folded;
+
+    gtk_tree_model_get(model, it, 0, &name, -1);
+    folded = fold_name(name);
+    if(folded) {
+        match = (strstr(folded, key) != NULL);
+        g_free(folded);
+    }
+    g_free(name);
+    return match;
+}
+
+LXPolkitDialog* lxpolkit_dialog_new(const char* ui_file, GError** error)
+{
+    LXPolkitDialog* dialog;
+    GtkBuilder* builder = gtk_builder_new();
+    GtkEntryCompletion* completion;
+#ifdef G_ENABLE_DEBUG
+    gint64 start = g_get_monotonic_time();
+#endif
+
+    gtk_builder_set_translation_domain(builder, GETTEXT_PACKAGE);
+    if(ui_file ? !gtk_builder_add_from_file(builder, ui_file, error)
+               : !gtk_builder_add_from_resource(builder, LXPOLKIT_DIALOG_RESOURCE, error)) {
+        g_object_unref(builder);
+        return NULL;
+    }
+
+    dialog = g_slice_new0(LXPolkitDialog);
+    dialog->dlg = (GtkWidget*)gtk_builder_get_object(builder, "dlg");
+    dialog->icon = (GtkWidget*)gtk_builder_get_object(builder, "icon");
+    dialog->msg = (GtkWidget*)gtk_builder_get_object(builder, "msg");
+    dialog->queue_label = (GtkWidget*)gtk_builder_get_object(builder, "queue_label");
+    dialog->id = (GtkWidget*)gtk_builder_get_object(builder, "id");
+    dialog->id_search = (GtkWidget*)gtk_builder_get_object(builder, "id_search");
+    dialog->request_label = (GtkWidget*)gtk_builder_get_object(builder, "request_label");
+    dialog->request = (GtkWidget*)gtk_builder_get_object(builder, "request");
+    dialog->info_box = (GtkWidget*)gtk_builder_get_object(builder, "info_box");
+    dialog->auth_button = (GtkWidget*)gtk_builder_get_object(builder, "auth");
+    dialog->auth_spin = (GtkWidget*)gtk_builder_get_object(builder, "auth_spin");
+    dialog->cancel_button = (GtkWidget*)gtk_builder_get_object(builder, "cancel");
+    /* GTK+ owns toplevel windows, so the widgets outlive the builder. */
+    g_object_unref(builder);
+
+    /* The completion popup is a tree view, which only renders the rows in
+     * sight, so it copes with thousands of identities. */
+    completion = gtk_entry_completion_new();
+    gtk_entry_completion_set_text_column(completion, 0);
+    gtk_entry_completion_set_match_func(completion, match_identity, NULL, NULL);
+    gtk_entry_set_completion(GTK_ENTRY(dialog->id_search), completion);
+    g_object_unref(completion);
+
+    /* render the default icon now rather than before the first frame */
+    lxpolkit_dialog_set_icon(dialog, NULL);
+
+    DEBUG("dialog built in %" G_GINT64_FORMAT " us", g_get_monotonic_time() - start);
+    return dialog;
+}
+
+void lxpolkit_dialog_free(LXPolkitDialog* dialog)
+{
+    if(!dialog)
+        return;
+    gtk_widget_destroy(dialog->dlg);
+    g_slice_free(LXPolkitDialog, dialog);
+}
+
+void lxpolkit_dialog_reset(LXPolkitDialog* dialog)
+{
+    gtk_widget_hide(dialog->dlg);
+    gtk_widget_set_sensitive(dialog->dlg, TRUE);
+
+    lxpolkit_dialog_set_icon(dialog, NULL);
+    gtk_label_set_text(GTK_LABEL(dialog->msg), "");
+    gtk_widget_hide(dialog->queue_label);
+    /* drops the identities of the last request along with the store */
+    gtk_combo_box_set_model(GTK_COMBO_BOX(dialog->id), NULL);
+    gtk_widget_show(dialog->id);
+    gtk_entry_completion_set_model(gtk_entry_get_completion(GTK_ENTRY(dialog->id_search)), NULL);
+    gtk_entry_set_text(GTK_ENTRY(dialog->id_search), "");
+    gtk_widget_hide(dialog->id_search);
+    gtk_label_set_text(GTK_LABEL(dialog->request_label), _("Password:"));
+    gtk_entry_set_text(GTK_ENTRY(dialog->request), "");
+    gtk_entry_set_visibility(GTK_ENTRY(dialog->request), FALSE);
+    /* the infobars are kept hidden for the messages of the next request */
+    gtk_container_foreach(GTK_CONTAINER(dialog->info_box), (GtkCallback)gtk_widget_hide, NULL);
+
+    gtk_spinner_stop(GTK_SPINNER(dialog->auth_spin));
+    gtk_widget_hide(dialog->auth_spin);
+    gtk_widget_set_sensitive(dialog->auth_button, TRUE);
+}
+
+gboolean lxpolkit_dialog_find_identity(LXPolkitDialog* dialog, gboolean partial, GtkTreeIter* it)
+{
+    GtkTreeModel* model = gtk_entry_completion_get_model(gtk_entry_get_completion(GTK_ENTRY(dialog->id_search)));
+    char* key = fold_name(gtk_entry_get_text(GTK_ENTRY(dialog->id_search)));
+    GtkTreeIter row;
+    gboolean valid, exact = FALSE;
+    int matches = 0;
+
+    if(!model || !key || !*key) {
+        g_free(key);
+        return FALSE;
+    }
+    for(valid = gtk_tree_model_get_iter_first(model, &row); valid && !exact;
+        valid = gtk_tree_model_iter_next(model, &row)) {
+        char* name;
+        char* folded;
+        gtk_tree_model_get(model, &row, 0, &name, -1);
+        folded = fold_name(name);
+        if(folded && strcmp(folded, key) == 0) {
+            *it = row;
+            exact = TRUE;
+        } else if(partial && folded && strstr(folded, key) && matches++ == 0)
+            *it = row;
+        g_free(folded);
+        g_free(name);
+    }
+    g_free(key);
+    return exact || matches == 1;
+}
+
+void lxpolkit_dialog_set_icon(LXPolkitDialog* dialog, const char* icon_name)
+{
+    lxpolkit_icons_set_image(GTK_IMAGE(dialog->icon), icon_name && *icon_name ? icon_name : DIALOG_ICON);
+}
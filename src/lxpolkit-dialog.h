@@ -0,0 +1,77 @@
+/*
+ *      lxpolkit-dialog.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_DIALOG_H__
+#define __LXPOLKIT_DIALOG_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/* The widgets of one authentication window, built from lxpolkit.ui. */
+typedef struct _LXPolkitDialog LXPolkitDialog;
+struct _LXPolkitDialog
+{
+    GtkWidget* dlg;
+    GtkWidget* icon;
+    GtkWidget* msg;
+    GtkWidget* queue_label;     /* how many requests wait behind this one */
+    GtkWidget* id;
+    GtkWidget* id_search;       /* replaces id for long identity lists */
+    GtkWidget* request_label;
+    GtkWidget* request;
+    GtkWidget* info_box;
+    GtkWidget* auth_button;
+    GtkWidget* auth_spin;
+    GtkWidget* cancel_button;
+};
+
+/* Path of lxpolkit.ui in the resources compiled into the binary. */
+#define LXPOLKIT_DIALOG_RESOURCE    "/org/lxde/lxpolkit/ui/lxpolkit.ui"
+
+/* Build a hidden dialog from the given GtkBuilder UI file, or from the
+ * embedded LXPOLKIT_DIALOG_RESOURCE if ui_file is NULL. */
+LXPolkitDialog* lxpolkit_dialog_new(const char* ui_file, GError** error);
+void lxpolkit_dialog_free(LXPolkitDialog* dialog);
+
+/* Hide the dialog and put every widget back into its freshly built state,
+ * so the next request can show it again. */
+void lxpolkit_dialog_reset(LXPolkitDialog* dialog);
+
+/* Find the identity named in id_search among the rows of its completion:
+ * the row whose name is the text in any case or, with partial, the only
+ * row whose name contains it. */
+gboolean lxpolkit_dialog_find_identity(LXPolkitDialog* dialog, gboolean partial, GtkTreeIter* it);
+
+/* Show icon_name, or the default icon if it is NULL or empty, rendered
+ * for the screen the dialog is on. */
+void lxpolkit_dialog_set_icon(LXPolkitDialog* dialog, const char* icon_name);
+
+/* Identity lists longer than this get the id_search entry instead of the
+ * id combo box. */
+#define LXPOLKIT_DIALOG_COMBO_MAX   20
+
+/* Idle dialogs kept around between requests. The listener shows one
+ * request at a time, so a single window serves them all. */
+#define LXPOLKIT_DIALOG_POOL_SIZE   1
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_DIALOG_H__ */
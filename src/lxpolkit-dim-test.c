@@ -0,0 +1,159 @@
+/*
+ *      lxpolkit-dim-test.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/* Check of the dim kernels, run by "make check".
+ *
+ * The kernel is picked once per process, so without LXPOLKIT_DIM set the
+ * program runs itself again for every kernel with LXPOLKIT_DIM naming it.
+ * A kernel this CPU does not have is skipped. Each run compares the output
+ * of lxpolkit_dim_pixels() with p * 2 / 5 for every byte value in every
+ * SIMD lane, and for every row width up to TAIL_MAX_WIDTH at every start
+ * offset up to a whole AVX2 register, so the unaligned loads and the
+ * scalar tails are covered too. Bytes of the alpha channel, the row
+ * padding and the guards around the image must come out unchanged. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "lxpolkit-dim.h"
+
+#define LANES           32      /* bytes in the widest register, AVX2 */
+#define MAX_OFFSET      LANES
+#define TAIL_MAX_WIDTH  80
+#define ROW_PADDING     5
+#define GUARD           LANES
+#define N_ROWS          3
+#define EXIT_SKIP       77      /* what automake calls a skipped test */
+
+static const char* kernels[] = { "scalar", "sse2", "avx2", "neon" };
+
+static const int channels[] = { 1, 3, 4 };
+
+/* Dim an image of width pixels starting offset bytes into a guarded
+ * buffer filled by fill(), and compare every byte of the buffer with what
+ * it should be. */
+static gboolean check_image(const char* what, int width, int n_channels, int offset,
+                            guchar (*fill)(gsize i, gpointer data), gpointer data)
+{
+    int row_bytes = width * n_channels;
+    int rowstride = row_bytes + ROW_PADDING;
+    gsize size = (gsize)GUARD + offset + (gsize)rowstride * N_ROWS + GUARD;
+    guchar* before = g_malloc(size);
+    guchar* after = g_malloc(size);
+    gboolean ok = TRUE;
+    gsize i;
+
+    for(i = 0; i < size; ++i)
+        before[i] = fill(i, data);
+    memcpy(after, before, size);
+    lxpolkit_dim_pixels(after + GUARD + offset, width, N_ROWS, rowstride, n_channels);
+
+    for(i = 0; i < size && ok; ++i) {
+        gsize pos = i - GUARD - offset;
+        guchar expected = before[i];
+        if(i >= GUARD + offset && pos < (gsize)rowstride * N_ROWS) {
+            int x = pos % rowstride;
+            if(x < row_bytes && !(n_channels == 4 && x % 4 == 3))
+                expected = before[i] * 2 / 5;
+        }
+        if(after[i] != expected) {
+            g_printerr("%s: %s, width %d, %d channels, offset %d: byte %" G_GSIZE_FORMAT
+                       " is %u from %u, not %u\n", lxpolkit_dim_get_impl_name(), what,
+                       width, n_channels, offset, i, after[i], before[i], expected);
+            ok = FALSE;
+        }
+    }
+    g_free(before);
+    g_free(after);
+    return ok;
+}
+
+/* Byte i of the buffer gets value i / LANES shifted by its lane, so each
+ * lane sees all 256 values over LANES * 256 bytes. */
+static guchar fill_sweep(gsize i, gpointer unused)
+{
+    return (guchar)(i / LANES + i % LANES);
+}
+
+static guchar fill_random(gsize i, gpointer rand)
+{
+    return (guchar)g_rand_int_range((GRand*)rand, 0, 256);
+}
+
+static int check_kernel(const char* kernel)
+{
+    GRand* rand = g_rand_new_with_seed(0x5eed);
+    gboolean ok = TRUE;
+    int c, offset, width;
+
+    if(strcmp(lxpolkit_dim_get_impl_name(), kernel) != 0) {
+        printf("%s: not supported, skipped\n", kernel);
+        return EXIT_SKIP;
+    }
+    for(c = 0; c < (int)G_N_ELEMENTS(channels) && ok; ++c) {
+        int n = channels[c];
+        /* every value in every lane, one row holding the whole sweep */
+        for(offset = 0; offset < MAX_OFFSET && ok; ++offset)
+            ok = check_image("byte values", (LANES * 256 + n - 1) / n, n, offset, fill_sweep, NULL);
+        for(width = 1; width <= TAIL_MAX_WIDTH && ok; ++width)
+            for(offset = 0; offset < MAX_OFFSET && ok; ++offset)
+                ok = check_image("tails", width, n, offset, fill_random, rand);
+    }
+    g_rand_free(rand);
+    printf("%s: %s\n", kernel, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    const char* kernel = g_getenv("LXPOLKIT_DIM");
+    gboolean failed = FALSE;
+    guint i;
+
+    /* a kernel failing the self check of debug builds warns and falls
+     * back to scalar, which must not pass for a skip */
+    g_log_set_always_fatal(G_LOG_LEVEL_WARNING | G_LOG_LEVEL_CRITICAL);
+    if(kernel)
+        return check_kernel(kernel);
+
+    for(i = 0; i < G_N_ELEMENTS(kernels); ++i) {
+        char* child_argv[] = { argv[0], NULL };
+        char** envp = g_environ_setenv(g_get_environ(), "LXPOLKIT_DIM", kernels[i], TRUE);
+        GError* err = NULL;
+        int status;
+
+        fflush(stdout);
+        if(!g_spawn_sync(NULL, child_argv, envp, G_SPAWN_CHILD_INHERITS_STDIN, NULL, NULL,
+                         NULL, NULL, &status, &err)) {
+            g_printerr("Error: %s\n", err->message);
+            g_error_free(err);
+            status = -1;
+        }
+        g_strfreev(envp);
+        if(!WIFEXITED(status) || (WEXITSTATUS(status) != 0 && WEXITSTATUS(status) != EXIT_SKIP)) {
+            g_printerr("%s kernel failed\n", kernels[i]);
+            failed = TRUE;
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,226 @@
+/*
+ *      lxpolkit-dim.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-dim.h"
+#include "lxpolkit-parallel.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DIM_HAVE_X86 1
+#endif
+
+#if defined(__GNUC__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DIM_HAVE_NEON 1
+#endif
+
+#ifdef G_ENABLE_DEBUG
+#define DEBUG(...)  g_debug(__VA_ARGS__)
+#else
+#define DEBUG(...)
+#endif
+
+/* p / 2.5 == p * 2 / 5, which for 0 <= p <= 255 is exactly (p * 205) >> 9.
+ * The product fits in 16 bits, so the SIMD paths can stay in u16 lanes. */
+#define DIM_MUL     205
+#define DIM_SHIFT   9
+#define DIM(p)      ((guchar)(((p) * DIM_MUL) >> DIM_SHIFT))
+
+typedef void (*DimRowFunc)(guchar* p, int n_bytes, gboolean has_alpha);
+
+/* Byte mask selecting the alpha channel of 4 consecutive RGBA pixels. */
+static const guchar alpha_mask[32] = {
+    0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff,
+    0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff
+};
+
+static void dim_row_scalar(guchar* p, int n_bytes, gboolean has_alpha)
+{
+    int i;
+    if(has_alpha) {
+        for(i = 0; i + 4 <= n_bytes; i += 4) {
+            p[i] = DIM(p[i]);
+            p[i + 1] = DIM(p[i + 1]);
+            p[i + 2] = DIM(p[i + 2]);
+        }
+    } else {
+        for(i = 0; i < n_bytes; ++i)
+            p[i] = DIM(p[i]);
+    }
+}
+
+#ifdef DIM_HAVE_X86
+__attribute__((target("sse2")))
+static void dim_row_sse2(guchar* p, int n_bytes, gboolean has_alpha)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mul = _mm_set1_epi16(DIM_MUL);
+    const __m128i keep = has_alpha ? _mm_loadu_si128((const __m128i*)alpha_mask) : zero;
+    int i;
+    for(i = 0; i + 16 <= n_bytes; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), mul), DIM_SHIFT);
+        __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), mul), DIM_SHIFT);
+        __m128i d = _mm_packus_epi16(lo, hi);
+        d = _mm_or_si128(_mm_andnot_si128(keep, d), _mm_and_si128(keep, v));
+        _mm_storeu_si128((__m128i*)(p + i), d);
+    }
+    dim_row_scalar(p + i, n_bytes - i, has_alpha);
+}
+
+__attribute__((target("avx2")))
+static void dim_row_avx2(guchar* p, int n_bytes, gboolean has_alpha)
+{
+    /* unpack and pack both work within 128 bit lanes, so byte order is kept. */
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i mul = _mm256_set1_epi16(DIM_MUL);
+    const __m256i keep = has_alpha ? _mm256_loadu_si256((const __m256i*)alpha_mask) : zero;
+    int i;
+    for(i = 0; i + 32 <= n_bytes; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(v, zero), mul), DIM_SHIFT);
+        __m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(v, zero), mul), DIM_SHIFT);
+        __m256i d = _mm256_packus_epi16(lo, hi);
+        d = _mm256_or_si256(_mm256_andnot_si256(keep, d), _mm256_and_si256(keep, v));
+        _mm256_storeu_si256((__m256i*)(p + i), d);
+    }
+    dim_row_scalar(p + i, n_bytes - i, has_alpha);
+}
+#endif
+
+#ifdef DIM_HAVE_NEON
+static void dim_row_neon(guchar* p, int n_bytes, gboolean has_alpha)
+{
+    const uint8x8_t mul = vdup_n_u8(DIM_MUL);
+    const uint8x16_t keep = has_alpha ? vld1q_u8(alpha_mask) : vdupq_n_u8(0);
+    int i;
+    for(i = 0; i + 16 <= n_bytes; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint16x8_t lo = vshrq_n_u16(vmull_u8(vget_low_u8(v), mul), DIM_SHIFT);
+        uint16x8_t hi = vshrq_n_u16(vmull_u8(vget_high_u8(v), mul), DIM_SHIFT);
+        uint8x16_t d = vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+        vst1q_u8(p + i, vbslq_u8(keep, v, d));
+    }
+    dim_row_scalar(p + i, n_bytes - i, has_alpha);
+}
+#endif
+
+static DimRowFunc dim_row = dim_row_scalar;
+static const char* dim_impl = "scalar";
+
+#ifdef G_ENABLE_DEBUG
+/* Compare a SIMD row kernel against the scalar one over every byte value,
+ * with odd tails and both pixel layouts. */
+static gboolean dim_check_impl(DimRowFunc func)
+{
+    guchar ref[1024 + 36], out[1024 + 36];
+    int n_bytes[2] = { 1023 + 33, 1024 + 36 };
+    int alpha, i;
+    for(alpha = 0; alpha < 2; ++alpha) {
+        for(i = 0; i < n_bytes[alpha]; ++i)
+            ref[i] = out[i] = (guchar)(i * 7 + (i >> 8));
+        dim_row_scalar(ref, n_bytes[alpha], alpha);
+        func(out, n_bytes[alpha], alpha);
+        if(memcmp(ref, out, n_bytes[alpha]) != 0)
+            return FALSE;
+    }
+    return TRUE;
+}
+#endif
+
+static void dim_try_impl(const char* force, const char* name, DimRowFunc func)
+{
+    if(force && strcmp(force, name) != 0)
+        return;
+#ifdef G_ENABLE_DEBUG
+    if(!dim_check_impl(func)) {
+        g_warning("%s dim kernel does not match the scalar one, not using it", name);
+        return;
+    }
+#endif
+    dim_row = func;
+    dim_impl = name;
+}
+
+/* Pick the widest row kernel this CPU supports.
+ * Setting LXPOLKIT_DIM=scalar|sse2|avx2|neon restricts the choice to one kernel. */
+static gpointer dim_select_impl(gpointer unused)
+{
+    const char* force = g_getenv("LXPOLKIT_DIM");
+#ifdef DIM_HAVE_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse2"))
+        dim_try_impl(force, "sse2", dim_row_sse2);
+    if(__builtin_cpu_supports("avx2"))
+        dim_try_impl(force, "avx2", dim_row_avx2);
+#endif
+#ifdef DIM_HAVE_NEON
+    dim_try_impl(force, "neon", dim_row_neon);
+#endif
+    DEBUG("dim kernel: %s", dim_impl);
+    return NULL;
+}
+
+const char* lxpolkit_dim_get_impl_name(void)
+{
+    static GOnce once = G_ONCE_INIT;
+    g_once(&once, dim_select_impl, NULL);
+    return dim_impl;
+}
+
+typedef struct _DimJob DimJob;
+struct _DimJob
+{
+    guchar* pixels;
+    int rowstride;
+    int row_bytes;
+    gboolean has_alpha;
+};
+
+static void dim_rows(int y0, int y1, gpointer user_data)
+{
+    DimJob* job = (DimJob*)user_data;
+    guchar* row = job->pixels + (gsize)y0 * job->rowstride;
+    int y;
+    for(y = y0; y < y1; ++y) {
+        dim_row(row, job->row_bytes, job->has_alpha);
+        row += job->rowstride;
+    }
+}
+
+void lxpolkit_dim_pixels(guchar* pixels, int width, int height, int rowstride, int n_channels)
+{
+    DimJob job;
+
+    g_return_if_fail(n_channels == 1 || n_channels == 3 || n_channels == 4);
+    if(!pixels || width <= 0 || height <= 0)
+        return;
+
+    lxpolkit_dim_get_impl_name();
+    job.pixels = pixels;
+    job.rowstride = rowstride;
+    job.row_bytes = width * n_channels;
+    job.has_alpha = (n_channels == 4);
+    lxpolkit_parallel_for(height, (gsize)job.row_bytes * height, dim_rows, &job);
+}
@@ -0,0 +1,38 @@
+/*
+ *      lxpolkit-dim.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_DIM_H__
+#define __LXPOLKIT_DIM_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Darken 1, 3 or 4 channel pixel data in place to 2/5 of its brightness.
+ * With 4 channels the last byte of every pixel (alpha) is left untouched;
+ * with 1 channel every byte of the row is darkened. */
+void lxpolkit_dim_pixels(guchar* pixels, int width, int height, int rowstride, int n_channels);
+
+/* Name of the row kernel picked for this CPU: "scalar", "sse2", "avx2" or "neon". */
+const char* lxpolkit_dim_get_impl_name(void);
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_DIM_H__ */
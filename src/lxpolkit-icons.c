@@ -0,0 +1,100 @@
+/*
+ *      lxpolkit-icons.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-icons.h"
+
+#ifdef G_ENABLE_DEBUG
+#define DEBUG(...)  g_debug(__VA_ARGS__)
+#else
+#define DEBUG(...)
+#endif
+
+/* "theme name size scale" -> cairo_surface_t, or NULL for a missing icon.
+ * Themes belong to screens, which live as long as the process. */
+static GHashTable* icons;
+
+static void on_theme_changed(GtkIconTheme* theme, gpointer unused)
+{
+    lxpolkit_icons_clear();
+}
+
+cairo_surface_t* lxpolkit_icons_lookup(GtkWidget* widget, const char* icon_name, int size)
+{
+    GtkIconTheme* theme = gtk_icon_theme_get_for_screen(gtk_widget_get_screen(widget));
+    int scale = gtk_widget_get_scale_factor(widget);
+    cairo_surface_t* surface = NULL;
+    GtkIconInfo* info;
+    GdkPixbuf* pixbuf;
+    gpointer cached;
+    char* key;
+#ifdef G_ENABLE_DEBUG
+    gint64 start = g_get_monotonic_time();
+#endif
+
+    if(!icons)
+        icons = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)cairo_surface_destroy);
+    key = g_strdup_printf("%p %s %d %d", (gpointer)theme, icon_name, size, scale);
+    if(g_hash_table_lookup_extended(icons, key, NULL, &cached)) {
+        g_free(key);
+        return (cairo_surface_t*)cached;
+    }
+    if(!g_object_get_data(G_OBJECT(theme), "lxpolkit-icons")) {
+        g_signal_connect(theme, "changed", G_CALLBACK(on_theme_changed), NULL);
+        g_object_set_data(G_OBJECT(theme), "lxpolkit-icons", GINT_TO_POINTER(TRUE));
+    }
+
+    /* Symbolic icons take the colours of the style of the widget. The
+     * dialog always uses the same theme variant, so they stay valid. */
+    info = gtk_icon_theme_lookup_icon_for_scale(theme, icon_name, size, scale, GTK_ICON_LOOKUP_FORCE_SIZE);
+    if(info) {
+        pixbuf = gtk_icon_info_load_symbolic_for_context(info, gtk_widget_get_style_context(widget), NULL, NULL);
+        if(pixbuf) {
+            surface = gdk_cairo_surface_create_from_pixbuf(pixbuf, scale, NULL);
+            g_object_unref(pixbuf);
+        }
+        g_object_unref(info);
+    }
+    /* missing icons are remembered too, they are not found the next time either */
+    g_hash_table_insert(icons, key, surface);
+    DEBUG("icon %s at %dx%d rendered in %" G_GINT64_FORMAT " us", icon_name, size, scale, g_get_monotonic_time() - start);
+    return surface;
+}
+
+void lxpolkit_icons_set_image(GtkImage* image, const char* icon_name)
+{
+    int size = gtk_image_get_pixel_size(image);
+    cairo_surface_t* surface;
+    if(size <= 0)
+        gtk_icon_size_lookup(GTK_ICON_SIZE_DIALOG, &size, NULL);
+    surface = lxpolkit_icons_lookup(GTK_WIDGET(image), icon_name, size);
+    if(surface)
+        gtk_image_set_from_surface(image, surface);
+    else
+        gtk_image_set_from_icon_name(image, icon_name, GTK_ICON_SIZE_DIALOG);
+}
+
+void lxpolkit_icons_clear(void)
+{
+    if(icons)
+        g_hash_table_remove_all(icons);
+}
@@ -0,0 +1,46 @@
+/*
+ *      lxpolkit-icons.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_ICONS_H__
+#define __LXPOLKIT_ICONS_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/* Icons rendered once and kept for the life of the process, keyed by the
+ * icon theme of the screen, the icon name, the size and the scale. All
+ * listeners share them; a change of the icon theme drops them. */
+
+/* The icon name at size pixels, rendered for the screen, scale and style
+ * of widget, or NULL if the theme has no such icon. The cache keeps the
+ * surface; the caller does not free it. */
+cairo_surface_t* lxpolkit_icons_lookup(GtkWidget* widget, const char* icon_name, int size);
+
+/* Show the icon name in image, at its pixel size, from the cache. Falls
+ * back to the icon name, so GTK+ draws its missing icon. */
+void lxpolkit_icons_set_image(GtkImage* image, const char* icon_name);
+
+/* Drop every rendered icon. */
+void lxpolkit_icons_clear(void);
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_ICONS_H__ */
@@ -0,0 +1,314 @@
+/*
+ *      lxpolkit-identity.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-identity.h"
+#include <glib/gi18n.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <pwd.h>
+#include <grp.h>
+
+#ifdef G_ENABLE_DEBUG
+#define DEBUG(...)  g_debug(__VA_ARGS__)
+#else
+#define DEBUG(...)
+#endif
+
+#define IDENTITY_MAX_THREADS    4
+/* getpwuid_r() and getgrgid_r() buffers grow up to this size. Large groups
+ * list every member in the buffer. */
+#define IDENTITY_MAX_BUFFER     (1024 * 1024)
+
+/* Cache keys hold the kind in the upper and the uid or gid in the lower half. */
+#define IDENTITY_USER           ((gint64)1 << 32)
+#define IDENTITY_GROUP          ((gint64)2 << 32)
+
+typedef struct _IdentityEntry IdentityEntry;
+struct _IdentityEntry
+{
+    char* name;
+    gint64 expires;         /* monotonic time the name goes stale */
+};
+
+typedef struct _IdentityWaiter IdentityWaiter;
+struct _IdentityWaiter
+{
+    LXPolkitIdentityFunc func;
+    gpointer user_data;
+};
+
+typedef struct _IdentityTask IdentityTask;
+struct _IdentityTask
+{
+    LXPolkitIdentityCache* cache;
+    gint64 key;
+    char* name;
+};
+
+struct _LXPolkitIdentityCache
+{
+    int ref_count;          /* the owner and every task in flight */
+    GThreadPool* pool;      /* NULL once the owner freed the cache */
+    GHashTable* entries;    /* key -> IdentityEntry */
+    GHashTable* pending;    /* key -> GSList of IdentityWaiter */
+    guint hits;
+    guint misses;
+};
+
+static gint64* identity_key_new(gint64 key)
+{
+    gint64* p = g_new(gint64, 1);
+    *p = key;
+    return p;
+}
+
+static void identity_entry_free(IdentityEntry* entry)
+{
+    g_free(entry->name);
+    g_slice_free(IdentityEntry, entry);
+}
+
+static char* resolve_user(uid_t uid)
+{
+    struct passwd pwd, *result = NULL;
+    gsize size = 512;
+    char* buf = NULL;
+    char* name;
+    int err;
+    do {
+        size *= 2;
+        buf = g_realloc(buf, size);
+        err = getpwuid_r(uid, &pwd, buf, size, &result);
+    } while(err == ERANGE && size < IDENTITY_MAX_BUFFER);
+    /* An unknown uid used to crash the agent; show the number instead. */
+    name = result ? g_strdup(pwd.pw_name) : g_strdup_printf("%u", (guint)uid);
+    g_free(buf);
+    return name;
+}
+
+static char* resolve_group(gid_t gid)
+{
+    struct group grp, *result = NULL;
+    gsize size = 512;
+    char* buf = NULL;
+    char* name;
+    int err;
+    do {
+        size *= 2;
+        buf = g_realloc(buf, size);
+        err = getgrgid_r(gid, &grp, buf, size, &result);
+    } while(err == ERANGE && size < IDENTITY_MAX_BUFFER);
+    if(result)
+        name = g_strdup_printf(_("Group: %s"), grp.gr_name);
+    else {
+        char* num = g_strdup_printf("%u", (guint)gid);
+        name = g_strdup_printf(_("Group: %s"), num);
+        g_free(num);
+    }
+    g_free(buf);
+    return name;
+}
+
+static void identity_log_stats(LXPolkitIdentityCache* cache)
+{
+    guint total = cache->hits + cache->misses;
+    DEBUG("identity cache: %u hits, %u misses, %u%% hit rate",
+          cache->hits, cache->misses, total ? cache->hits * 100 / total : 0);
+}
+
+static void identity_cache_unref(LXPolkitIdentityCache* cache)
+{
+    if(--cache->ref_count > 0)
+        return;
+    g_hash_table_destroy(cache->entries);
+    g_hash_table_destroy(cache->pending);
+    g_slice_free(LXPolkitIdentityCache, cache);
+}
+
+static void identity_notify(GSList* waiters, const char* name)
+{
+    GSList* l;
+    /* waiters were prepended, call them in the order they asked */
+    waiters = g_slist_reverse(waiters);
+    for(l = waiters; l; l = l->next) {
+        IdentityWaiter* waiter = (IdentityWaiter*)l->data;
+        waiter->func(name, waiter->user_data);
+        g_slice_free(IdentityWaiter, waiter);
+    }
+    g_slist_free(waiters);
+}
+
+/* Back in the main loop with a resolved name. */
+static gboolean identity_complete(gpointer user_data)
+{
+    IdentityTask* task = (IdentityTask*)user_data;
+    LXPolkitIdentityCache* cache = task->cache;
+    gpointer orig_key, waiters;
+
+    if(cache->pool) {
+        IdentityEntry* entry = g_slice_new(IdentityEntry);
+        entry->name = g_strdup(task->name);
+        entry->expires = g_get_monotonic_time() + LXPOLKIT_IDENTITY_TTL;
+        g_hash_table_insert(cache->entries, identity_key_new(task->key), entry);
+        /* stealing skips the destroy function, so the key is freed here */
+        if(g_hash_table_steal_extended(cache->pending, &task->key, &orig_key, &waiters)) {
+            g_free(orig_key);
+            identity_notify((GSList*)waiters, task->name);
+        }
+    }
+    identity_cache_unref(cache);
+    g_free(task->name);
+    g_slice_free(IdentityTask, task);
+    return FALSE;
+}
+
+static void identity_worker(gpointer data, gpointer unused)
+{
+    IdentityTask* task = (IdentityTask*)data;
+    guint32 id = (guint32)task->key;
+#ifdef G_ENABLE_DEBUG
+    gint64 start = g_get_monotonic_time();
+#endif
+    if((task->key & ~(gint64)G_MAXUINT32) == IDENTITY_USER)
+        task->name = resolve_user((uid_t)id);
+    else
+        task->name = resolve_group((gid_t)id);
+    DEBUG("resolved %s in %" G_GINT64_FORMAT " us", task->name, g_get_monotonic_time() - start);
+    g_idle_add_full(G_PRIORITY_DEFAULT, identity_complete, task, NULL);
+}
+
+static gboolean identity_get_key(PolkitIdentity* id, gint64* key)
+{
+    if(POLKIT_IS_UNIX_USER(id))
+        *key = IDENTITY_USER | (guint32)polkit_unix_user_get_uid(POLKIT_UNIX_USER(id));
+    else if(POLKIT_IS_UNIX_GROUP(id))
+        *key = IDENTITY_GROUP | (guint32)polkit_unix_group_get_gid(POLKIT_UNIX_GROUP(id));
+    else
+        return FALSE;
+    return TRUE;
+}
+
+LXPolkitIdentityCache* lxpolkit_identity_cache_new(void)
+{
+    LXPolkitIdentityCache* cache = g_slice_new0(LXPolkitIdentityCache);
+    cache->ref_count = 1;
+    cache->pool = g_thread_pool_new(identity_worker, NULL, IDENTITY_MAX_THREADS, FALSE, NULL);
+    cache->entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, (GDestroyNotify)identity_entry_free);
+    cache->pending = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+    return cache;
+}
+
+void lxpolkit_identity_cache_free(LXPolkitIdentityCache* cache)
+{
+    GHashTableIter it;
+    gpointer waiters;
+    GSList* all = NULL, *l;
+
+    if(!cache)
+        return;
+    /* Running lookups finish in the background and only drop their reference. */
+    g_thread_pool_free(cache->pool, FALSE, FALSE);
+    cache->pool = NULL;
+    /* take the waiters out first, the table frees its keys */
+    g_hash_table_iter_init(&it, cache->pending);
+    while(g_hash_table_iter_next(&it, NULL, &waiters))
+        all = g_slist_prepend(all, waiters);
+    g_hash_table_remove_all(cache->pending);
+    for(l = all; l; l = l->next)
+        identity_notify((GSList*)l->data, NULL);
+    g_slist_free(all);
+    identity_cache_unref(cache);
+}
+
+char* lxpolkit_identity_cache_lookup(LXPolkitIdentityCache* cache, PolkitIdentity* id)
+{
+    IdentityEntry* entry;
+    gint64 key;
+
+    /* other kinds of identities need no lookup */
+    if(!identity_get_key(id, &key))
+        return polkit_identity_to_string(id);
+
+    entry = (IdentityEntry*)g_hash_table_lookup(cache->entries, &key);
+    if(entry && entry->expires > g_get_monotonic_time()) {
+        ++cache->hits;
+        identity_log_stats(cache);
+        return g_strdup(entry->name);
+    }
+    ++cache->misses;
+    identity_log_stats(cache);
+    return NULL;
+}
+
+void lxpolkit_identity_cache_resolve(LXPolkitIdentityCache* cache, PolkitIdentity* id,
+                                     LXPolkitIdentityFunc func, gpointer user_data)
+{
+    IdentityWaiter* waiter;
+    gpointer waiters = NULL;
+    gint64 key;
+
+    if(!identity_get_key(id, &key)) {
+        char* name = polkit_identity_to_string(id);
+        func(name, user_data);
+        g_free(name);
+        return;
+    }
+
+    waiter = g_slice_new(IdentityWaiter);
+    waiter->func = func;
+    waiter->user_data = user_data;
+    if(g_hash_table_lookup_extended(cache->pending, &key, NULL, &waiters)) {
+        /* the lookup is already queued, just wait for it too */
+        g_hash_table_insert(cache->pending, identity_key_new(key), g_slist_prepend((GSList*)waiters, waiter));
+    } else {
+        IdentityTask* task = g_slice_new0(IdentityTask);
+        task->cache = cache;
+        task->key = key;
+        ++cache->ref_count;
+        g_hash_table_insert(cache->pending, identity_key_new(key), g_slist_prepend(NULL, waiter));
+        g_thread_pool_push(cache->pool, task, NULL);
+    }
+}
+
+void lxpolkit_identity_cache_trim(LXPolkitIdentityCache* cache)
+{
+    DEBUG("identity cache: dropping %u names", g_hash_table_size(cache->entries));
+    g_hash_table_remove_all(cache->entries);
+}
+
+GList* lxpolkit_identity_find_default(GList* identities, PolkitIdentity* last, gint uid)
+{
+    GList* l, *user = NULL;
+    for(l = identities; l; l = l->next) {
+        PolkitIdentity* id = (PolkitIdentity*)l->data;
+        if(last && polkit_identity_equal(id, last))
+            return l;
+        if(!user && POLKIT_IS_UNIX_USER(id) && polkit_unix_user_get_uid(POLKIT_UNIX_USER(id)) == uid) {
+            if(!last)
+                return l;
+            user = l;
+        }
+    }
+    return user ? user : identities;
+}
@@ -0,0 +1,61 @@
+/*
+ *      lxpolkit-identity.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_IDENTITY_H__
+#define __LXPOLKIT_IDENTITY_H__
+
+#include <glib.h>
+#include <polkit/polkit.h>
+
+G_BEGIN_DECLS
+
+/* Display names of polkit identities. User and group names are looked up
+ * by worker threads, since NSS may have to ask a remote directory, and are
+ * kept for LXPOLKIT_IDENTITY_TTL. */
+typedef struct _LXPolkitIdentityCache LXPolkitIdentityCache;
+
+/* Called from the main loop once a name is known. name is NULL if the
+ * cache was freed before the lookup finished. */
+typedef void (*LXPolkitIdentityFunc)(const char* name, gpointer user_data);
+
+LXPolkitIdentityCache* lxpolkit_identity_cache_new(void);
+void lxpolkit_identity_cache_free(LXPolkitIdentityCache* cache);
+
+/* Returns a newly allocated display name of id if it is cached, or NULL if
+ * it has to be resolved first. Never blocks. */
+char* lxpolkit_identity_cache_lookup(LXPolkitIdentityCache* cache, PolkitIdentity* id);
+
+/* Resolve the name of id in a worker thread and pass it to func. Lookups of
+ * the same identity already in flight are shared. */
+void lxpolkit_identity_cache_resolve(LXPolkitIdentityCache* cache, PolkitIdentity* id,
+                                     LXPolkitIdentityFunc func, gpointer user_data);
+
+/* Forget every cached name. Lookups in flight still finish. */
+void lxpolkit_identity_cache_trim(LXPolkitIdentityCache* cache);
+
+/* The identity to offer first: last if it is among identities, else the
+ * user uid, else the first one. */
+GList* lxpolkit_identity_find_default(GList* identities, PolkitIdentity* last, gint uid);
+
+#define LXPOLKIT_IDENTITY_TTL   (5 * 60 * G_USEC_PER_SEC)
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_IDENTITY_H__ */
@@ -24,14 +24,20 @@
 #endif
 
 #include "lxpolkit-listener.h"
+#include "lxpolkit-agent.h"
+#include "lxpolkit-dialog.h"
+#include "lxpolkit-icons.h"
+#include "lxpolkit-notify.h"
+#include "lxpolkit-probes.h"
+#include "lxpolkit-stats.h"
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 #include <string.h>
-
-#include <sys/types.h>
-#include <pwd.h>
-#include <grp.h>
+#include <unistd.h>
+#ifdef HAVE_MALLOC_TRIM
+#include <malloc.h>
+#endif
 
 #ifdef G_ENABLE_DEBUG
 #define DEBUG(...)  g_debug(__VA_ARGS__)
@@ -39,6 +45,8 @@
 #define DEBUG(...)
 #endif
 
+#define REQUEST_PROBE(data, name)   LXPOLKIT_PROBE(name, (data)->cookie, (data)->action_id, (data)->start)
+
 static void lxpolkit_listener_finalize  			(GObject *object);
 
 G_DEFINE_TYPE(LXPolkitListener, lxpolkit_listener, POLKIT_AGENT_TYPE_LISTENER);
@@ -48,132 +56,483 @@ struct _DlgData
 {
     LXPolkitListener* listener;
     GSimpleAsyncResult* result;
-    GtkWidget* dlg;
-    GtkWidget* id;
-    GtkWidget* request;
-    GtkWidget* request_label;
-    GtkWidget* auth_button;
-    GtkWidget* auth_spin;
-    GtkWidget* info_box;
+    LXPolkitDialog* dialog;
     GCancellable* cancellable;
     GAsyncReadyCallback callback;
     gpointer user_data;
     char* cookie;
     char* action_id;
-    PolkitAgentSession* session;
+    LXPolkitSessionManager* sessions;
+    PolkitIdentity* identity;       /* the selected identity */
+    GList* identities;              /* our references to the identities to choose from */
+    GtkListStore* store;            /* display names and identities */
+    GList* fill_next;               /* first identity not yet added to a searched store */
+    guint fill_source;
+    int unnamed;                    /* names being resolved, plus one until the store is filled */
+    GtkTreeRowReference* selected;  /* row of the selected identity in a searched store */
+    gboolean search_edited;         /* the search entry does not name the selected identity */
+    char* message;
+    char* icon_name;
+    gint64 start;                   /* monotonic time the request came in */
+    char* response;                 /* the last answer typed for this request */
+    int responses;                  /* answers typed since the last failed attempt */
+    gboolean echo_on;               /* the last question was not for a secret */
+    char* auto_response;            /* answer of an earlier request, tried before asking */
+    GSList* group;                  /* cookies of the requests the last answer may answer too */
+    guint show_source;
 };
 
+/* Identity lists longer than LXPOLKIT_DIALOG_COMBO_MAX are added to their
+ * store a chunk at a time from the main loop. */
+#define IDENTITY_FILL_CHUNK     128
+
+/* Infobars a dialog shows at a time. */
+#define INFO_BAR_MAX            3
+
+/* Actions of the group listed in the window before the rest are counted. */
+#define GROUP_LABEL_MAX         5
+
 /* defined in lxpolkit.c */
-void show_msg(GtkWindow* parent, GtkMessageType type, const char* msg);
+GtkWidget* show_msg(GtkWindow* parent, GtkMessageType type, const char* msg);
 void show_info(const gchar *msg, GtkMessageType type, DlgData* data);
 
 static void on_cancelled(GCancellable* cancellable, DlgData* data);
 static inline void dlg_data_free(DlgData* data);
 static void on_user_changed(GtkComboBox* id_combo, DlgData* data);
+static gboolean on_identity_match(GtkEntryCompletion* completion, GtkTreeModel* model, GtkTreeIter* it, DlgData* data);
+static void on_search_changed(GtkEditable* entry, DlgData* data);
+static void on_search_activate(GtkEntry* entry, DlgData* data);
+static gboolean on_search_focus_out(GtkWidget* entry, GdkEvent* event, DlgData* data);
+static void on_store_row_changed(GtkTreeModel* model, GtkTreePath* path, GtkTreeIter* it, DlgData* data);
+static void release_dialog(LXPolkitListener* self, LXPolkitDialog* dialog);
+static void show_request(DlgData* data);
+static void select_identity(DlgData* data, PolkitIdentity* id, gboolean debounce);
+static void schedule_idle_trim(LXPolkitListener* self);
+static void update_queue_label(LXPolkitListener* self);
+static void free_secret(char* secret);
 
-static void auth_clicked(GtkButton * button, GtkWidget *info, DlgData *data);
-static void cancel_clicked(GtkButton * button, GtkWidget *info, DlgData *data);
-static GdkPixbuf * get_background_pixbuf(void);
-gboolean draw(GtkWidget * widget, cairo_t * cr, GdkPixbuf * pixbuf);
+static void auth_clicked(GtkButton * button, DlgData *data);
+static void cancel_clicked(GtkButton * button, DlgData *data);
+gboolean draw(GtkWidget * widget, cairo_t * cr, cairo_surface_t * surface);
+static gboolean on_map_event(GtkWidget* widget, GdkEvent* event, DlgData* data);
+static gboolean on_first_frame(GtkWidget* widget, cairo_t* cr, DlgData* data);
 
 static GApplication *polapp;
 
+/* Listeners of all sessions served by the process share identity names. */
+static LXPolkitIdentityCache* shared_identities;
+static int n_listeners;
+
 inline void dlg_data_free(DlgData* data)
 {
+    LXPolkitListener* self = data->listener;
     DEBUG("dlg_data_free");
-    gtk_widget_hide(data->dlg);
-    gtk_widget_destroy(data->dlg);
+    if(lxpolkit_request_queue_remove(&self->requests, data))
+        update_queue_label(self);
+
+    if(data->dialog) {
+        /* Hand the window back to the pool without the handlers of this request. */
+        g_signal_handlers_disconnect_matched(data->dialog->dlg, G_SIGNAL_MATCH_FUNC, 0, 0, NULL, draw, NULL);
+        g_signal_handlers_disconnect_by_func(data->dialog->dlg, on_map_event, data);
+        g_signal_handlers_disconnect_by_func(data->dialog->dlg, on_first_frame, data);
+        g_signal_handlers_disconnect_by_func(data->dialog->id, on_user_changed, data);
+        g_signal_handlers_disconnect_by_func(gtk_entry_get_completion(GTK_ENTRY(data->dialog->id_search)), on_identity_match, data);
+        g_signal_handlers_disconnect_by_func(data->dialog->id_search, on_search_changed, data);
+        g_signal_handlers_disconnect_by_func(data->dialog->id_search, on_search_activate, data);
+        g_signal_handlers_disconnect_by_func(data->dialog->id_search, on_search_focus_out, data);
+        g_signal_handlers_disconnect_by_func(data->dialog->auth_button, auth_clicked, data);
+        g_signal_handlers_disconnect_by_func(data->dialog->cancel_button, cancel_clicked, data);
+        release_dialog(data->listener, data->dialog);
+    }
 
     g_signal_handlers_disconnect_by_func(data->cancellable, on_cancelled, data);
     g_object_unref(data->cancellable);
-    g_object_unref(data->session);
+    lxpolkit_session_manager_free(data->sessions);
+    if(data->fill_source)
+        g_source_remove(data->fill_source);
+    if(data->show_source)
+        g_source_remove(data->show_source);
+    if(data->store) {
+        /* names still being resolved find the store without its request */
+        g_object_set_data(G_OBJECT(data->store), "request", NULL);
+        g_signal_handlers_disconnect_by_func(data->store, on_store_row_changed, data);
+        g_object_unref(data->store);
+    }
+    if(data->selected)
+        gtk_tree_row_reference_free(data->selected);
+    if(data->identity)
+        g_object_unref(data->identity);
+    g_list_free_full(data->identities, g_object_unref);
     g_object_unref(data->result);
+    free_secret(data->response);
+    free_secret(data->auto_response);
+    g_slist_free_full(data->group, g_free);
+    g_free(data->icon_name);
+    g_free(data->message);
     g_free(data->action_id);
     g_free(data->cookie);
     g_slice_free(DlgData, data);
 }
 
-static void on_completed(PolkitAgentSession* session, gboolean authorized, DlgData* data) {
+/* Wipe an answer before it goes back to the allocator. */
+static void free_secret(char* secret)
+{
+    if(secret) {
+        memset(secret, 0, strlen(secret));
+        g_free(secret);
+    }
+}
+
+/* Whether two requests offer the same identities, in any order. */
+static gboolean same_identities(GList* a, GList* b)
+{
+    GHashTable* set;
+    gboolean same = TRUE;
+    if(g_list_length(a) != g_list_length(b))
+        return FALSE;
+    set = g_hash_table_new((GHashFunc)polkit_identity_hash, (GEqualFunc)polkit_identity_equal);
+    for(; a; a = a->next)
+        g_hash_table_add(set, a->data);
+    for(; b && same; b = b->next)
+        same = g_hash_table_contains(set, b->data);
+    g_hash_table_destroy(set);
+    return same;
+}
+
+static void forget_shared_response(LXPolkitListener* self)
+{
+    free_secret(self->shared_response);
+    self->shared_response = NULL;
+    if(self->shared_identity) {
+        g_object_unref(self->shared_identity);
+        self->shared_identity = NULL;
+    }
+    g_slist_free_full(self->shared_cookies, g_free);
+    self->shared_cookies = NULL;
+}
+
+/* The waiting requests that offer the same identities as data, which its
+ * answer is tried on, oldest first. */
+static GSList* find_group(DlgData* data)
+{
+    GSList* group = NULL;
+    GList* l;
+    for(l = data->listener->requests.waiting.tail; l; l = l->prev)
+        if(same_identities(((DlgData*)l->data)->identities, data->identities))
+            group = g_slist_prepend(group, l->data);
+    return group;
+}
+
+/* Keep the answer of an authorized request for the requests of its group
+ * that were waiting when it was typed, and which the window listed. A
+ * request coming in later is asked on its own, so nobody can time one to
+ * ride on a password typed for something else. Only a single secret
+ * answer is kept, a conversation of several questions is asked again. */
+static void share_response(DlgData* data)
+{
+    LXPolkitListener* self = data->listener;
+    if(!data->dialog || !data->response || data->responses != 1 || data->echo_on || !data->group)
+        return;
+    forget_shared_response(self);
+    self->shared_response = data->response;
+    data->response = NULL;
+    self->shared_identity = (PolkitIdentity*)g_object_ref(data->identity);
+    self->shared_cookies = data->group;
+    data->group = NULL;
+}
+
+/* Tell the user how many requests wait behind the one shown, and which of
+ * them the password typed now answers too. */
+static void update_queue_label(LXPolkitListener* self)
+{
+    DlgData* data = (DlgData*)self->requests.current;
+    guint n = g_queue_get_length(&self->requests.waiting);
+    GSList* group, *l;
+    GString* text;
+    guint i;
+    if(!data || !data->dialog)
+        return;
+    if(n == 0) {
+        gtk_widget_hide(data->dialog->queue_label);
+        return;
+    }
+    text = g_string_new(NULL);
+    g_string_printf(text, ngettext("%u more request waiting", "%u more requests waiting", n), n);
+    group = find_group(data);
+    if(group) {
+        g_string_append_c(text, '\n');
+        g_string_append(text, _("If the password is accepted, it also answers:"));
+        for(l = group, i = 0; l; l = l->next, ++i) {
+            if(i == GROUP_LABEL_MAX) {
+                guint rest = g_slist_length(l);
+                g_string_append_c(text, '\n');
+                g_string_append_printf(text, ngettext("and %u more request", "and %u more requests", rest), rest);
+                break;
+            }
+            g_string_append_printf(text, "\n\u2022 %s", ((DlgData*)l->data)->message);
+        }
+        g_slist_free(group);
+    }
+    gtk_label_set_text(GTK_LABEL(data->dialog->queue_label), text->str);
+    g_string_free(text, TRUE);
+    gtk_widget_show(data->dialog->queue_label);
+}
+
+/* Requests are shown one at a time. The next one is the first waiting
+ * request the kept answer was typed for, which gets it without a prompt,
+ * else the oldest waiting request. */
+static void run_next_request(LXPolkitRequestQueue* queue, gpointer user_data)
+{
+    LXPolkitListener* self = (LXPolkitListener*)user_data;
+    DlgData* data;
+    GSList* cookie = NULL;
+    GList* l;
+
+    if(self->shared_response) {
+        for(l = queue->waiting.head; l; l = l->next) {
+            cookie = g_slist_find_custom(self->shared_cookies, ((DlgData*)l->data)->cookie, (GCompareFunc)strcmp);
+            if(cookie)
+                break;
+        }
+        if(cookie) {
+            data = (DlgData*)lxpolkit_request_queue_pop(queue, l);
+            DEBUG("answering request %s with the answer of its group", data->cookie);
+            g_free(cookie->data);
+            self->shared_cookies = g_slist_delete_link(self->shared_cookies, cookie);
+            data->auto_response = g_strdup(self->shared_response);
+            select_identity(data, self->shared_identity, FALSE);
+            /* the answer is not kept past the requests it was typed for */
+            if(!self->shared_cookies)
+                forget_shared_response(self);
+            return;
+        }
+        forget_shared_response(self);
+    }
+    data = (DlgData*)lxpolkit_request_queue_pop(queue, NULL);
+    if(data)
+        show_request(data);
+    else
+        schedule_idle_trim(self);
+}
+
+/* Nothing was asked for a while: give back what the next request can
+ * build again. GTK+ cannot open the display again once it was closed, so
+ * the display connection and with it the icon theme stay. */
+static gboolean trim_idle(gpointer user_data)
+{
+    LXPolkitListener* self = (LXPolkitListener*)user_data;
+    self->idle_source = 0;
+    lxpolkit_backdrop_invalidate(self->backdrop);
+    g_slist_free_full(self->idle_dialogs, (GDestroyNotify)lxpolkit_dialog_free);
+    self->idle_dialogs = NULL;
+    free_shades(self);
+    lxpolkit_identity_cache_trim(self->identities);
+    lxpolkit_icons_clear();
+    g_thread_pool_stop_unused_threads();
+#ifdef HAVE_MALLOC_TRIM
+    malloc_trim(0);
+#endif
+    self->trimmed = TRUE;
+    lxpolkit_agent_trace("idle caches trimmed");
+    return FALSE;
+}
+
+static void schedule_idle_trim(LXPolkitListener* self)
+{
+    if(self->idle_source) {
+        g_source_remove(self->idle_source);
+        self->idle_source = 0;
+    }
+    if(self->idle_trim && !self->trimmed && !self->requests.current && g_queue_is_empty(&self->requests.waiting))
+        self->idle_source = g_timeout_add_seconds(self->idle_trim * 60, trim_idle, self);
+}
+
+void lxpolkit_listener_set_idle_trim(LXPolkitListener* self, guint minutes)
+{
+    self->idle_trim = minutes;
+    schedule_idle_trim(self);
+}
+
+static gboolean show_request_idle(gpointer user_data)
+{
+    DlgData* data = (DlgData*)user_data;
+    data->show_source = 0;
+    show_request(data);
+    return FALSE;
+}
+
+static void on_completed(gboolean authorized, gpointer user_data) {
+    DlgData* data = (DlgData*)user_data;
     DEBUG("on_complete");
-    gtk_widget_set_sensitive(data->dlg, TRUE);
+    REQUEST_PROBE(data, completed);
+    if(data->dialog)
+        gtk_widget_set_sensitive(data->dialog->dlg, TRUE);
 
     if(!authorized && !g_cancellable_is_cancelled(data->cancellable)) {
-        gtk_spinner_stop(GTK_SPINNER (data->auth_spin));
-        gtk_widget_hide(data->auth_spin);
-        gtk_widget_set_sensitive(data->auth_button, TRUE);
-        GNotification *donenoti = g_notification_new ("Wrong Password");
-        GIcon *doneicon = g_themed_icon_new ("dialog-password-symbolic");
-        g_notification_set_icon (donenoti, doneicon);
-        g_application_send_notification (polapp, NULL, donenoti);
-        //show_msg(GTK_WINDOW (data->dlg), GTK_MESSAGE_ERROR, _("Authentication failed! Wrong password?"));
+        if(!data->dialog) {
+            /* the answer of the group does not do here, ask the user */
+            forget_shared_response(data->listener);
+            free_secret(data->auto_response);
+            data->auto_response = NULL;
+            show_request(data);
+            return;
+        }
+        lxpolkit_stats_wrong_answer();
+        data->responses = 0;
+        gtk_spinner_stop(GTK_SPINNER (data->dialog->auth_spin));
+        gtk_widget_hide(data->dialog->auth_spin);
+        update_auth_button(data);
+        lxpolkit_notify(polapp, LXPOLKIT_NOTIFY_WRONG_PASSWORD);
+        //show_msg(GTK_WINDOW (data->dialog->dlg), GTK_MESSAGE_ERROR, _("Authentication failed! Wrong password?"));
         show_info(_("Authentication failed! Wrong password?"), GTK_MESSAGE_ERROR, data);
-        /* initiate a new session */
-        g_object_unref(data->session);
-        data->session = NULL;
-        gtk_entry_set_text(GTK_ENTRY (data->request), "");
-        gtk_widget_grab_focus(data->request);
-        on_user_changed(GTK_COMBO_BOX (data->id), data);
+        /* the session manager already moved on to a new session */
+        gtk_entry_set_text(GTK_ENTRY (data->dialog->request), "");
+        gtk_widget_grab_focus(data->dialog->request);
         return;
     } else {
-        GNotification *donenoti = g_notification_new ("Authenticated");
-        GIcon *doneicon = g_themed_icon_new ("dialog-password-symbolic");
-        g_notification_set_icon (donenoti, doneicon);
-        g_application_send_notification (polapp, NULL, donenoti);
+        if(authorized) {
+            /* offer the same identity first next time */
+            if(data->listener->last_identity)
+                g_object_unref(data->listener->last_identity);
+            data->listener->last_identity = g_object_ref(data->identity);
+            share_response(data);
+            lxpolkit_notify(polapp, LXPOLKIT_NOTIFY_AUTHORIZED);
+        }
     }
+    lxpolkit_stats_request_finished(authorized ? LXPOLKIT_OUTCOME_AUTHORIZED : LXPOLKIT_OUTCOME_CANCELLED,
+                                    g_get_monotonic_time() - data->start);
     g_simple_async_result_complete(data->result);
     dlg_data_free(data);
 }
 
-static void on_request(PolkitAgentSession* session, gchar* request, gboolean echo_on, DlgData* data) {
+static void on_request(const char* request, gboolean echo_on, gpointer user_data) {
+    DlgData* data = (DlgData*)user_data;
     const char* msg;
     DEBUG("on_request: %s", request);
+    REQUEST_PROBE(data, helper_request);
+    if(!data->dialog) {
+        if(data->auto_response && !echo_on) {
+            lxpolkit_session_manager_respond(data->sessions, data->auto_response);
+            REQUEST_PROBE(data, response_sent);
+            free_secret(data->auto_response);
+            data->auto_response = NULL;
+        } else if(!data->show_source) {
+            /* a question the answer of the group cannot take */
+            data->show_source = g_idle_add(show_request_idle, data);
+        }
+        return;
+    }
+    data->echo_on = echo_on;
     if(strcmp("Password: ", request) == 0)
         msg = _("Password: ");
     else
         msg = request;
-    gtk_label_set_text(GTK_LABEL (data->request_label), msg);
-    gtk_entry_set_visibility(GTK_ENTRY (data->request), echo_on);
+    gtk_label_set_text(GTK_LABEL (data->dialog->request_label), msg);
+    gtk_entry_set_visibility(GTK_ENTRY (data->dialog->request), echo_on);
 }
 
-static void on_show_error(PolkitAgentSession* session, gchar* text, DlgData* data) {
+static void on_show_error(const char* text, gpointer user_data) {
+    DlgData* data = (DlgData*)user_data;
     DEBUG("on error: %s", text);
-    GtkWidget *dialog;
-    dialog = gtk_message_dialog_new (GTK_WINDOW (data->dlg),
-        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-        GTK_MESSAGE_ERROR,
-        GTK_BUTTONS_OK_CANCEL,
-        text);
-    gtk_dialog_run (GTK_DIALOG (dialog));
-    gtk_widget_destroy (dialog);
+    if(data->dialog)
+        show_info(text, GTK_MESSAGE_ERROR, data);
 }
 
-static void on_show_info(PolkitAgentSession* session, gchar* text, DlgData* data) {
+static void on_show_info(const char* text, gpointer user_data) {
+    DlgData* data = (DlgData*)user_data;
     DEBUG("on info: %s", text);
-    GtkWidget *dialog;
-    dialog = gtk_message_dialog_new (GTK_WINDOW (data->dlg),
-        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-        GTK_MESSAGE_INFO,
-        GTK_BUTTONS_OK_CANCEL,
-        text);
-    gtk_dialog_run (GTK_DIALOG (dialog));
-    gtk_widget_destroy (dialog);
+    if(data->dialog)
+        show_info(text, GTK_MESSAGE_INFO, data);
 }
 
+static const LXPolkitSessionFuncs session_funcs = {
+    on_completed,
+    on_request,
+    on_show_error,
+    on_show_info
+};
+
+/* Show a message in an infobar below the password entry. The info box holds
+ * at most INFO_BAR_MAX bars: a dismissed bar or one with the same text is
+ * used again, and when the box is full the oldest bar takes the message. */
 void show_info(const gchar *msg, GtkMessageType type, DlgData* data) {
-    GtkWidget *info = gtk_info_bar_new();
+    GList* bars = gtk_container_get_children(GTK_CONTAINER (data->dialog->info_box));
+    GtkWidget *info = NULL, *label;
+    GList* l;
+    for(l = bars; l; l = l->next) {
+        label = (GtkWidget*)g_object_get_data(G_OBJECT (l->data), "label");
+        if(!gtk_widget_get_visible(GTK_WIDGET (l->data)) || strcmp(gtk_label_get_text(GTK_LABEL (label)), msg) == 0) {
+            info = (GtkWidget*)l->data;
+            break;
+        }
+    }
+    if(!info && g_list_length(bars) >= INFO_BAR_MAX)
+        info = (GtkWidget*)bars->data;
+    g_list_free(bars);
+
+    if(info)
+        label = (GtkWidget*)g_object_get_data(G_OBJECT (info), "label");
+    else {
+        info = gtk_info_bar_new();
+        gtk_info_bar_set_show_close_button (GTK_INFO_BAR (info), TRUE);
+        g_signal_connect(info, "response", G_CALLBACK (gtk_widget_hide), NULL);
+        label = gtk_label_new(NULL);
+        gtk_label_set_line_wrap(GTK_LABEL (label), TRUE);
+        gtk_container_add(GTK_CONTAINER (gtk_info_bar_get_content_area(GTK_INFO_BAR (info))), label);
+        g_object_set_data(G_OBJECT (info), "label", label);
+        gtk_container_add(GTK_CONTAINER (data->dialog->info_box), info);
+    }
     gtk_info_bar_set_message_type (GTK_INFO_BAR (info), type);
-    gtk_container_add(GTK_CONTAINER (gtk_info_bar_get_content_area(GTK_INFO_BAR (info))), gtk_label_new(msg));
-    gtk_container_add(GTK_CONTAINER (data->info_box), info);
-    gtk_widget_show_all(data->info_box);
+    gtk_label_set_text(GTK_LABEL (label), msg);
+    /* the newest message goes last */
+    gtk_box_reorder_child(GTK_BOX (data->dialog->info_box), info, -1);
+    gtk_widget_show_all(info);
 }
 
 void on_cancelled(GCancellable* cancellable, DlgData* data)
 {
     DEBUG("on_cancelled");
-    if(data->session)
-        polkit_agent_session_cancel(data->session);
-    else
+    if(!lxpolkit_session_manager_cancel(data->sessions)) {
+        lxpolkit_stats_request_finished(LXPOLKIT_OUTCOME_CANCELLED, g_get_monotonic_time() - data->start);
+        g_simple_async_result_complete_in_idle(data->result);
         dlg_data_free(data);
+    }
+}
+
+/* A name was resolved or the store is filled. After the last one, every
+ * identity is in the store with its name. */
+static void identity_named(DlgData* data)
+{
+    if(--data->unnamed == 0)
+        REQUEST_PROBE(data, identities_named);
+}
+
+/* The name of an identity shown in the combo box is known. */
+static void on_identity_resolved(const char* name, gpointer user_data)
+{
+    GtkTreeRowReference* row = (GtkTreeRowReference*)user_data;
+    GtkTreeModel* model = gtk_tree_row_reference_get_model(row);
+    GtkTreePath* path = gtk_tree_row_reference_get_path(row);
+    DlgData* data = (DlgData*)g_object_get_data(G_OBJECT(model), "request");
+    GtkTreeIter it;
+    if(path) {
+        /* the row is gone if the request finished in the meantime */
+        if(name && gtk_tree_model_get_iter(model, &it, path))
+            gtk_list_store_set(GTK_LIST_STORE(model), &it, 0, name, -1);
+        gtk_tree_path_free(path);
+    }
+    gtk_tree_row_reference_free(row);
+    if(data)
+        identity_named(data);
+}
+
+/* Authenticate as id from now on. Identities that are scrolled through
+ * are debounced, so only the one the user stops at gets a helper. */
+static void select_identity(DlgData* data, PolkitIdentity* id, gboolean debounce) {
+    if(data->identity)
+        g_object_unref(data->identity);
+    data->identity = (PolkitIdentity*)g_object_ref(id);
+    lxpolkit_session_manager_select(data->sessions, id, debounce);
 }
 
 /* A different user is selected. */
@@ -184,24 +543,275 @@ static void on_user_changed(GtkComboBox* id_combo, DlgData* data) {
     if(gtk_combo_box_get_active_iter(id_combo, &it)) {
         PolkitIdentity* id;
         gtk_tree_model_get(model, &it, 1, &id, -1);
-        if(data->session) /* delete old session object */
-        {
-            /* prevent receiving completed signal. */
-            g_signal_handlers_disconnect_matched(data->session, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, data);
-            polkit_agent_session_cancel(data->session);
-            g_object_unref(data->session);
-        }
-        /* create authentication session for currently selected user */
-        data->session = polkit_agent_session_new(id, data->cookie);
+        select_identity(data, id, TRUE);
         g_object_unref(id);
-        g_signal_connect(data->session, "completed", G_CALLBACK(on_completed), data);
-        g_signal_connect(data->session, "request", G_CALLBACK(on_request), data);
-        g_signal_connect(data->session, "show-error", G_CALLBACK(on_show_error), data);
-        g_signal_connect(data->session, "show-info", G_CALLBACK(on_show_info), data);
-        polkit_agent_session_initiate(data->session);
     }
 }
 
+/* Authenticate as the identity of a row of a searched store. */
+static void select_row(DlgData* data, GtkTreeModel* model, GtkTreeIter* it) {
+    PolkitIdentity* id;
+    GtkTreePath* path = gtk_tree_model_get_path(model, it);
+    gtk_tree_row_reference_free(data->selected);
+    data->selected = gtk_tree_row_reference_new(model, path);
+    gtk_tree_path_free(path);
+    gtk_tree_model_get(model, it, 1, &id, -1);
+    select_identity(data, id, FALSE);
+    g_object_unref(id);
+}
+
+/* Authenticate can be pressed unless an answer is being checked or the
+ * search entry names someone else than the identity the password is for. */
+static void update_auth_button(DlgData* data) {
+    gtk_widget_set_sensitive(data->dialog->auth_button,
+                             !data->search_edited && !gtk_widget_get_visible(data->dialog->auth_spin));
+}
+
+/* A user is picked from the search results. */
+static gboolean on_identity_match(GtkEntryCompletion* completion, GtkTreeModel* model, GtkTreeIter* it, DlgData* data) {
+    DEBUG("on_identity_match");
+    select_row(data, model, it);
+    gtk_widget_grab_focus(data->dialog->request);
+    /* let the entry take the name of the row */
+    return FALSE;
+}
+
+/* The search entry was edited. Until it names the selected identity again
+ * the password would go to someone else than the one shown. */
+static void on_search_changed(GtkEditable* entry, DlgData* data) {
+    GtkTreePath* path = gtk_tree_row_reference_get_path(data->selected);
+    GtkTreeModel* model = GTK_TREE_MODEL(data->store);
+    GtkTreeIter it;
+    gboolean edited = TRUE;
+    if(path) {
+        if(gtk_tree_model_get_iter(model, &it, path)) {
+            char* name;
+            gtk_tree_model_get(model, &it, 0, &name, -1);
+            edited = (g_strcmp0(name, gtk_entry_get_text(GTK_ENTRY(entry))) != 0);
+            g_free(name);
+        }
+        gtk_tree_path_free(path);
+    }
+    data->search_edited = edited;
+    update_auth_button(data);
+}
+
+/* Take the identity typed without picking it from the results. A name
+ * contained in several others only counts once the list is complete. */
+static void resolve_search(DlgData* data) {
+    GtkTreeIter it;
+    if(data->search_edited && lxpolkit_dialog_find_identity(data->dialog, !data->fill_source, &it)) {
+        char* name;
+        select_row(data, GTK_TREE_MODEL(data->store), &it);
+        gtk_tree_model_get(GTK_TREE_MODEL(data->store), &it, 0, &name, -1);
+        gtk_entry_set_text(GTK_ENTRY(data->dialog->id_search), name);
+        g_free(name);
+    }
+}
+
+static void on_search_activate(GtkEntry* entry, DlgData* data) {
+    resolve_search(data);
+    if(!data->search_edited)
+        gtk_widget_grab_focus(data->dialog->request);
+}
+
+static gboolean on_search_focus_out(GtkWidget* entry, GdkEvent* event, DlgData* data) {
+    resolve_search(data);
+    return FALSE;
+}
+
+/* Show the name of the selected identity once it is resolved, unless the
+ * user typed something else into the search entry. */
+static void on_store_row_changed(GtkTreeModel* model, GtkTreePath* path, GtkTreeIter* it, DlgData* data) {
+    GtkTreePath* selected = gtk_tree_row_reference_get_path(data->selected);
+    if(selected) {
+        if(gtk_tree_path_compare(path, selected) == 0 && !data->search_edited) {
+            char* name;
+            gtk_tree_model_get(model, it, 0, &name, -1);
+            gtk_entry_set_text(GTK_ENTRY(data->dialog->id_search), name);
+            g_free(name);
+        }
+        gtk_tree_path_free(selected);
+    }
+}
+
+/* Add a row for id to the store, named from the cache or, until its name
+ * is resolved, with the raw identity. */
+static void add_identity(DlgData* data, PolkitIdentity* id, GtkTreeIter* it) {
+    char* name = lxpolkit_identity_cache_lookup(data->listener->identities, id);
+    if(name) {
+        gtk_list_store_insert_with_values(data->store, it, -1, 0, name, 1, id, -1);
+        g_free(name);
+    } else {
+        GtkTreePath* path;
+        name = polkit_identity_to_string(id);
+        gtk_list_store_insert_with_values(data->store, it, -1, 0, name, 1, id, -1);
+        g_free(name);
+        path = gtk_tree_model_get_path(GTK_TREE_MODEL(data->store), it);
+        ++data->unnamed;
+        lxpolkit_identity_cache_resolve(data->listener->identities, id, on_identity_resolved,
+                                        gtk_tree_row_reference_new(GTK_TREE_MODEL(data->store), path));
+        gtk_tree_path_free(path);
+    }
+}
+
+/* Add the next chunk of a long identity list to its store. */
+static gboolean fill_identities(gpointer user_data) {
+    DlgData* data = (DlgData*)user_data;
+    GtkTreeIter it;
+    int n = 0;
+    for(; data->fill_next && n < IDENTITY_FILL_CHUNK; data->fill_next = data->fill_next->next, ++n)
+        add_identity(data, (PolkitIdentity*)data->fill_next->data, &it);
+    if(data->fill_next)
+        return TRUE;
+    DEBUG("identity list filled");
+    data->fill_source = 0;
+    identity_named(data);
+    return FALSE;
+}
+
+/* GTK+ connects to the display, reads its settings and loads the icon
+ * theme only for the first request, so none of it delays the login. */
+static gboolean open_display(LXPolkitListener* self, GError** error)
+{
+    GdkScreen* screen;
+    if(self->display)
+        return TRUE;
+    if(self->display_name) {
+        /* Xlib takes the authority file from the environment when it
+         * connects, so set the one of the session just for that. */
+        char* saved = g_strdup(g_getenv("XAUTHORITY"));
+        if(self->xauthority)
+            g_setenv("XAUTHORITY", self->xauthority, TRUE);
+        self->display = gdk_display_open(self->display_name);
+        if(self->xauthority) {
+            if(saved)
+                g_setenv("XAUTHORITY", saved, TRUE);
+            else
+                g_unsetenv("XAUTHORITY");
+        }
+        g_free(saved);
+        /* GTK+ wants a default display; the first session provides it */
+        if(self->display && !gdk_display_get_default())
+            gdk_display_manager_set_default_display(gdk_display_manager_get(), self->display);
+    } else if(gtk_init_check(NULL, NULL))
+        self->display = gdk_display_get_default();
+    if(!self->display) {
+        g_set_error(error, POLKIT_ERROR, POLKIT_ERROR_FAILED, "Cannot open display %s",
+                    self->display_name ? self->display_name : g_getenv("DISPLAY"));
+        return FALSE;
+    }
+    screen = gdk_display_get_default_screen(self->display);
+    lxpolkit_backdrop_set_screen(self->backdrop, screen);
+    g_object_set (gtk_settings_get_for_screen (screen), "gtk-dialogs-use-header", TRUE, "gtk-application-prefer-dark-theme", TRUE, NULL);
+    lxpolkit_agent_trace("display opened");
+    return TRUE;
+}
+
+void lxpolkit_listener_set_display_name(LXPolkitListener* self, const char* display_name)
+{
+    g_free(self->display_name);
+    self->display_name = g_strdup(display_name);
+}
+
+void lxpolkit_listener_set_xauthority(LXPolkitListener* self, const char* xauthority)
+{
+    g_free(self->xauthority);
+    self->xauthority = g_strdup(xauthority);
+}
+
+void lxpolkit_listener_set_user(LXPolkitListener* self, gint uid)
+{
+    self->uid = uid;
+}
+
+/* Take an idle dialog from the pool, building a new one only when every
+ * dialog is in use by another request. */
+static LXPolkitDialog* acquire_dialog(LXPolkitListener* self, GError** error)
+{
+    LXPolkitDialog* dialog;
+    if(!open_display(self, error))
+        return NULL;
+    if(self->idle_dialogs) {
+        dialog = (LXPolkitDialog*)self->idle_dialogs->data;
+        self->idle_dialogs = g_slist_delete_link(self->idle_dialogs, self->idle_dialogs);
+        return dialog;
+    }
+    dialog = lxpolkit_dialog_new(NULL, error);
+    if(dialog)
+        gtk_window_set_screen(GTK_WINDOW(dialog->dlg), gdk_display_get_default_screen(self->display));
+    return dialog;
+}
+
+/* The monitors without the dialog only get a plain dark window, translucent
+ * with a compositing manager, so one capture covers the whole request. */
+static void show_shades(LXPolkitListener* self, GdkScreen* screen, int monitor, GdkVisual* visual)
+{
+    int i, n = gdk_screen_get_n_monitors(screen);
+    guint used = 0;
+
+    if(!self->shades)
+        self->shades = g_ptr_array_new_with_free_func((GDestroyNotify)gtk_widget_destroy);
+    for(i = 0; i < n; ++i) {
+        GtkWidget* shade;
+        GdkRectangle geometry;
+        if(i == monitor)
+            continue;
+        if(used < self->shades->len)
+            shade = (GtkWidget*)g_ptr_array_index(self->shades, used);
+        else {
+            shade = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+            gtk_window_set_decorated(GTK_WINDOW(shade), FALSE);
+            gtk_window_set_accept_focus(GTK_WINDOW(shade), FALSE);
+            gtk_window_set_skip_taskbar_hint(GTK_WINDOW(shade), TRUE);
+            gtk_window_set_skip_pager_hint(GTK_WINDOW(shade), TRUE);
+            gtk_widget_set_app_paintable(shade, TRUE);
+            g_signal_connect(shade, "draw", G_CALLBACK(draw), NULL);
+            g_ptr_array_add(self->shades, shade);
+        }
+        ++used;
+        if(gtk_widget_get_screen(shade) != screen)
+            gtk_window_set_screen(GTK_WINDOW(shade), screen);
+        if(gtk_widget_get_visual(shade) != visual) {
+            gtk_widget_unrealize(shade);
+            gtk_widget_set_visual(shade, visual);
+        }
+        gtk_window_fullscreen_on_monitor(GTK_WINDOW(shade), screen, i);
+        gdk_screen_get_monitor_geometry(screen, i, &geometry);
+        gtk_window_move(GTK_WINDOW(shade), geometry.x, geometry.y);
+        gtk_window_set_default_size(GTK_WINDOW(shade), geometry.width, geometry.height);
+        gtk_widget_show(shade);
+    }
+    /* monitors that went away */
+    if(used < self->shades->len)
+        g_ptr_array_remove_range(self->shades, used, self->shades->len - used);
+}
+
+static void hide_shades(LXPolkitListener* self)
+{
+    guint i;
+    for(i = 0; self->shades && i < self->shades->len; ++i)
+        gtk_widget_hide((GtkWidget*)g_ptr_array_index(self->shades, i));
+}
+
+static void free_shades(LXPolkitListener* self)
+{
+    if(self->shades) {
+        g_ptr_array_free(self->shades, TRUE);
+        self->shades = NULL;
+    }
+}
+
+static void release_dialog(LXPolkitListener* self, LXPolkitDialog* dialog)
+{
+    hide_shades(self);
+    lxpolkit_dialog_reset(dialog);
+    if(g_slist_length(self->idle_dialogs) < LXPOLKIT_DIALOG_POOL_SIZE)
+        self->idle_dialogs = g_slist_prepend(self->idle_dialogs, dialog);
+    else
+        lxpolkit_dialog_free(dialog);
+}
+
 static void initiate_authentication(PolkitAgentListener  *listener,
                                     const gchar          *action_id,
                                     const gchar          *message,
@@ -213,21 +823,15 @@ static void initiate_authentication(PolkitAgentListener  *listener,
                                     GAsyncReadyCallback   callback,
                                     gpointer              user_data)
 {
-    g_print("Application is requesting authentication: \r\n");
-    g_print(message);
-    g_print("\r\n With the icon: \r\n");
-    g_print(icon_name);
-    g_print("\r\n And ActionID \r\n");
-    g_print(action_id);
-    GtkWidget *icon, *msg;
-    GList* l;
     DlgData* data = g_slice_new0(DlgData);
     DEBUG("init_authentication");
     DEBUG("action_id = %s", action_id);
 #ifdef G_ENABLE_DEBUG
+    char** keys = polkit_details_get_keys(details);
     char** p;
-    for(p = polkit_details_get_keys(details);*p;++p)
-        g_print("%s: %s", *p, polkit_details_lookup(details, *p));
+    for(p = keys; p && *p; ++p)
+        DEBUG("%s: %s", *p, polkit_details_lookup(details, *p));
+    g_strfreev(keys);
 #endif
     data->listener = (LXPolkitListener*)listener;
     
@@ -238,218 +842,210 @@ static void initiate_authentication(PolkitAgentListener  *listener,
     data->callback = callback;
     data->user_data = user_data;
     data->cookie = g_strdup(cookie);
-    data->auth_button = (GtkWidget*)gtk_button_new();
-    data->auth_spin = (GtkWidget*)gtk_spinner_new ();
-    data->dlg = (GtkWidget*)gtk_window_new(GTK_WINDOW_TOPLEVEL);
-    icon = (GtkWidget*)gtk_image_new_from_icon_name("dialog-password-symbolic", 0);
-    data->id = (GtkWidget*)gtk_combo_box_new ();
-    data->request = (GtkWidget*)gtk_entry_new ();
-    data->request_label = (GtkWidget*)gtk_label_new("Password:");
-    data->info_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 1);
-
-    /* set dialog icon */
-    if(icon_name && *icon_name)
-        gtk_image_set_from_icon_name(GTK_IMAGE(icon), icon_name, GTK_ICON_SIZE_DIALOG);
-    else
-        gtk_image_set_from_icon_name(GTK_IMAGE(icon), "dialog-password-symbolic", GTK_ICON_SIZE_DIALOG);
+    data->message = g_strdup(message);
+    data->icon_name = g_strdup(icon_name);
+    data->start = g_get_monotonic_time();
+    REQUEST_PROBE(data, request_received);
+    lxpolkit_stats_request_received(action_id);
+    data->sessions = lxpolkit_session_manager_new(cookie, &session_funcs, data);
+    g_signal_connect(data->cancellable, "cancelled", G_CALLBACK(on_cancelled), data);
 
-    /* create combo box for user selection */
-    if( identities ) {
-        GtkListStore* store = gtk_list_store_new(2, G_TYPE_STRING, G_TYPE_OBJECT);
-        g_signal_connect(data->id, "changed", G_CALLBACK(on_user_changed), data);
-        for(l = identities; l; l=l->next) {
-            PolkitIdentity* id = (PolkitIdentity*)l->data;
-            char* name;
-            if(POLKIT_IS_UNIX_USER(id)) {
-                struct passwd* pwd = getpwuid(polkit_unix_user_get_uid(POLKIT_UNIX_USER(id)));
-                gtk_list_store_insert_with_values(store, NULL, -1, 0, pwd->pw_name, 1, id, -1);
-            } else if(POLKIT_IS_UNIX_GROUP(id)) {
-                struct group* grp = getgrgid(polkit_unix_group_get_gid(POLKIT_UNIX_GROUP(id)));
-                char* str = g_strdup_printf(_("Group: %s"), grp->gr_name);
-                gtk_list_store_insert_with_values(store, NULL, -1, 0, str, 1, id, -1);
-                g_free(str);
-            } else {
-                /* FIXME: what's this? */
-                
-                char* str = polkit_identity_to_string(id);
-                gtk_list_store_insert_with_values(store, NULL, -1, 0, str, 1, id, -1);
-                g_free(str);
-            }
-        }
-        gtk_combo_box_set_model(GTK_COMBO_BOX (data->id), GTK_TREE_MODEL(store));
-        GtkCellRenderer *pwdrend = gtk_cell_renderer_text_new ();
-        gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (data->id), pwdrend, TRUE);
-        gtk_cell_layout_add_attribute (GTK_CELL_LAYOUT (data->id), pwdrend, "text", 0);
-
-        g_object_unref(store);
-        /* select the fist user in the list */
-        gtk_combo_box_set_active(GTK_COMBO_BOX (data->id), 0);
-    } else {
-        GtkWidget *dialog;
-        dialog = gtk_message_dialog_new (GTK_WINDOW (data->dlg),
-            GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
-            GTK_MESSAGE_INFO,
-            GTK_BUTTONS_OK,
-            "No Users Found");
-        gtk_dialog_run (GTK_DIALOG (dialog));
-        gtk_widget_destroy (dialog);
+    if(!identities) {
+        /* Nothing to authenticate as. Tell the user without waiting for a click. */
+        lxpolkit_notify(polapp, LXPOLKIT_NOTIFY_NO_USERS);
 
         DEBUG("no identities list, is this an error?");
+        g_simple_async_result_set_error(data->result, POLKIT_ERROR, POLKIT_ERROR_FAILED, "No identities to authenticate as");
+        lxpolkit_stats_request_finished(LXPOLKIT_OUTCOME_FAILED, g_get_monotonic_time() - data->start);
         g_simple_async_result_complete_in_idle(data->result);
         dlg_data_free(data);
         return;
     }
-    
-    g_object_set (gtk_settings_get_default (), "gtk-dialogs-use-header", TRUE, "gtk-application-prefer-dark-theme", TRUE, NULL);
-    
-    /* Get the background pixbuf. */
-    GdkPixbuf * pixbuf = get_background_pixbuf();
-
-    /* Create the toplevel window. */
-    gtk_window_set_decorated(GTK_WINDOW(data->dlg), FALSE);
-    gtk_window_fullscreen(GTK_WINDOW(data->dlg));
-    gtk_window_set_title(GTK_WINDOW(data->dlg), "Authenticate");
-    gtk_window_set_icon_name(GTK_WINDOW(data->dlg), "dialog-password-symbolic");
-    GdkScreen* screen = gtk_widget_get_screen(data->dlg);
-    gtk_window_set_default_size(GTK_WINDOW(data->dlg), gdk_screen_get_width(screen), gdk_screen_get_height(screen));
-    gtk_widget_set_app_paintable(data->dlg, TRUE);
-    g_signal_connect(G_OBJECT(data->dlg), "draw", G_CALLBACK(draw), pixbuf);
-
-    /* Toplevel container */
-    GtkWidget* alignment = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-    gtk_widget_set_halign (alignment, GTK_ALIGN_CENTER);
-    gtk_widget_set_valign (alignment, GTK_ALIGN_CENTER);
-    gtk_container_add(GTK_CONTAINER(data->dlg), alignment);
-
-    GtkWidget* center_area = gtk_event_box_new();
-    gtk_container_add(GTK_CONTAINER(alignment), center_area);
-
-    GtkWidget* center_vbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
-    gtk_container_set_border_width(GTK_CONTAINER(center_vbox), 12);
-    gtk_container_add(GTK_CONTAINER(center_area), center_vbox);
-
-    GtkWidget* controls = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
-    gtk_widget_set_halign (controls, GTK_ALIGN_CENTER);
-    gtk_widget_set_valign (controls, GTK_ALIGN_CENTER);
-
-    gtk_image_set_pixel_size (GTK_IMAGE (icon), 128);
-    
-    gtk_box_pack_start(GTK_BOX(center_vbox), icon, FALSE, FALSE, 2);
-    gtk_box_pack_start(GTK_BOX(center_vbox), controls, FALSE, FALSE, 2);
+    data->identities = g_list_copy_deep(identities, (GCopyFunc)g_object_ref, NULL);
 
-    /* Create the label. */
-    GtkWidget * label = gtk_label_new("");
-    gtk_label_set_markup(GTK_LABEL(label), g_strdup_printf(_("<b><big>%s</big></b>"), message));
-    gtk_box_pack_start(GTK_BOX(controls), label, FALSE, FALSE, 4);
-    
-    GtkWidget* lcontrols = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
-    gtk_widget_set_halign (lcontrols, GTK_ALIGN_START);
-    gtk_widget_set_valign (lcontrols, GTK_ALIGN_CENTER);
-    
-    /* User Picker */
-    gtk_box_pack_start(GTK_BOX(lcontrols), data->id, FALSE, FALSE, 2);
-    
-    gtk_widget_set_halign (data->request_label, GTK_ALIGN_START);
-    gtk_box_pack_start(GTK_BOX(lcontrols), data->request_label, FALSE, FALSE, 2);
-    
-    /* Password Box */
-    gtk_entry_set_placeholder_text (GTK_ENTRY (data->request), "Password");
-    gtk_entry_set_icon_from_icon_name (GTK_ENTRY (data->request), GTK_ENTRY_ICON_SECONDARY, "dialog-password-symbolic");
-    gtk_box_pack_start(GTK_BOX(lcontrols), data->request, FALSE, FALSE, 2);
-    
-    gtk_widget_set_size_request (lcontrols, 400, -1);
-    gtk_box_pack_start(GTK_BOX(controls), lcontrols, FALSE, FALSE, 2);
-    
-    gtk_box_pack_start(GTK_BOX(lcontrols), data->info_box, FALSE, FALSE, 2);
-    
-    /* Add Buttons */
-    GtkWidget *btnbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
-    gtk_box_pack_start(GTK_BOX(controls), btnbox, FALSE, FALSE, 0);
-    GtkAccelGroup* accel_group = gtk_accel_group_new();
-    gtk_window_add_accel_group(GTK_WINDOW(data->dlg), accel_group);
-
-    /* Authenticate */
-    GtkWidget * lolabel = gtk_label_new_with_mnemonic (_("_Authenticate"));
-	gtk_style_context_add_class(gtk_widget_get_style_context(data->auth_button), "suggested-action");
-    GtkWidget *authbtnbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
-    gtk_container_add(GTK_CONTAINER (authbtnbox), lolabel);
-    gtk_container_add(GTK_CONTAINER (authbtnbox), data->auth_spin);
-    gtk_container_add(GTK_CONTAINER (data->auth_button), authbtnbox);
-    g_signal_connect(G_OBJECT(data->auth_button), "clicked", G_CALLBACK(auth_clicked), data);
-    gtk_widget_add_accelerator(data->auth_button, "activate", accel_group,
-        GDK_KEY_KP_Enter, (GdkModifierType)0, GTK_ACCEL_VISIBLE);
-    gtk_box_pack_start(GTK_BOX(btnbox), data->auth_button, FALSE, FALSE, 3);
-
-    /* Create the Cancel button. */
-    GtkWidget * cancel_button = gtk_button_new();
-    GtkWidget * cnlabel = gtk_label_new_with_mnemonic (_("_Cancel"));
-    gtk_container_add(GTK_CONTAINER (cancel_button), cnlabel);
-    g_signal_connect(G_OBJECT(cancel_button), "clicked", G_CALLBACK(cancel_clicked), NULL);
-    gtk_widget_add_accelerator(cancel_button, "activate", accel_group,
-        GDK_KEY_Escape, (GdkModifierType)0, GTK_ACCEL_VISIBLE);
-    gtk_box_pack_start(GTK_BOX(btnbox), cancel_button, FALSE, FALSE, 3);
+    /* Wait for the window behind the requests that came first. */
+    lxpolkit_request_queue_push(&data->listener->requests, data);
+    schedule_idle_trim(data->listener);
+    update_queue_label(data->listener);
+}
+
+/* Put a request into the window and let it ask for its first identity. */
+static void show_request(DlgData* data)
+{
+    GList* l, *def;
+    GtkTreeIter it;
+    GError* err = NULL;
+#ifdef G_ENABLE_DEBUG
+    gint64 start = g_get_monotonic_time();
+#endif
+    if(data->show_source) {
+        g_source_remove(data->show_source);
+        data->show_source = 0;
+    }
+    data->dialog = acquire_dialog(data->listener, &err);
+    if(!data->dialog) {
+        g_warning("Cannot load the authentication dialog: %s", err->message);
+        lxpolkit_stats_request_finished(LXPOLKIT_OUTCOME_FAILED, g_get_monotonic_time() - data->start);
+        g_simple_async_result_take_error(data->result, err);
+        g_simple_async_result_complete_in_idle(data->result);
+        dlg_data_free(data);
+        return;
+    }
 
+    /* set dialog icon, rendered once per name for the screen of the dialog */
+    lxpolkit_dialog_set_icon(data->dialog, data->icon_name);
 
-    /* Show everything. */
-    gtk_widget_show_all(data->dlg);
-    gtk_widget_hide(data->auth_spin);
-    gtk_entry_set_input_purpose (GTK_ENTRY (data->request), GTK_INPUT_PURPOSE_PASSWORD);
-    gtk_widget_grab_focus (data->request);
-}
-
-/* Get the background pixbuf. */
-static GdkPixbuf * get_background_pixbuf(void) {
-    /* Get the root window pixmap. */
-    GdkScreen * screen = gdk_screen_get_default();
-    GdkPixbuf * pixbuf = gdk_pixbuf_get_from_window(gdk_get_default_root_window(), 0, 0, gdk_screen_get_width(screen), gdk_screen_get_height(screen));	
-
-    /* Make the background darker. */
-    if (pixbuf != NULL) {
-        unsigned char * pixels = gdk_pixbuf_get_pixels(pixbuf);
-        int width = gdk_pixbuf_get_width(pixbuf);
-        int height = gdk_pixbuf_get_height(pixbuf);
-        int pixel_stride = ((gdk_pixbuf_get_has_alpha(pixbuf)) ? 4 : 3);
-        int row_stride = gdk_pixbuf_get_rowstride(pixbuf);
-        int y;
-        for (y = 0; y < height; y += 1) {
-            unsigned char * p = pixels;
-            int x;
-            for (x = 0; x < width; x += 1)
-            {
-                p[0] = p[0] / 2.5;
-                p[1] = p[1] / 2.5;
-                p[2] = p[2] / 2.5;
-                p += pixel_stride;
-            }
-            pixels += row_stride;
+    /* create combo box for user selection */
+    data->store = gtk_list_store_new(2, G_TYPE_STRING, G_TYPE_OBJECT);
+    g_object_set_data(G_OBJECT(data->store), "request", data);
+    data->unnamed = 1;
+    def = lxpolkit_identity_find_default(data->identities, data->listener->last_identity,
+                                         data->listener->uid >= 0 ? data->listener->uid : (gint)getuid());
+    if(g_list_length(data->identities) <= LXPOLKIT_DIALOG_COMBO_MAX) {
+        int i = 0, active = 0;
+        for(l = data->identities; l; l=l->next, ++i) {
+            add_identity(data, (PolkitIdentity*)l->data, &it);
+            if(l == def)
+                active = i;
         }
+        gtk_combo_box_set_model(GTK_COMBO_BOX (data->dialog->id), GTK_TREE_MODEL(data->store));
+        gtk_combo_box_set_active(GTK_COMBO_BOX (data->dialog->id), active);
+        select_identity(data, (PolkitIdentity*)def->data, FALSE);
+        g_signal_connect(data->dialog->id, "changed", G_CALLBACK(on_user_changed), data);
+        identity_named(data);
+    } else {
+        /* Too many to scroll through: show the default identity in a
+         * search entry and add the others in the background. */
+        GtkEntryCompletion* completion = gtk_entry_get_completion(GTK_ENTRY(data->dialog->id_search));
+        GtkTreePath* path;
+        char* name;
+        /* the default identity becomes the first row */
+        data->identities = g_list_concat(def, g_list_remove_link(data->identities, def));
+        add_identity(data, (PolkitIdentity*)def->data, &it);
+        path = gtk_tree_model_get_path(GTK_TREE_MODEL(data->store), &it);
+        data->selected = gtk_tree_row_reference_new(GTK_TREE_MODEL(data->store), path);
+        gtk_tree_path_free(path);
+        gtk_tree_model_get(GTK_TREE_MODEL(data->store), &it, 0, &name, -1);
+        gtk_entry_set_text(GTK_ENTRY(data->dialog->id_search), name);
+        g_free(name);
+
+        gtk_entry_completion_set_model(completion, GTK_TREE_MODEL(data->store));
+        g_signal_connect(completion, "match-selected", G_CALLBACK(on_identity_match), data);
+        g_signal_connect(data->store, "row-changed", G_CALLBACK(on_store_row_changed), data);
+        g_signal_connect(data->dialog->id_search, "changed", G_CALLBACK(on_search_changed), data);
+        g_signal_connect(data->dialog->id_search, "activate", G_CALLBACK(on_search_activate), data);
+        g_signal_connect(data->dialog->id_search, "focus-out-event", G_CALLBACK(on_search_focus_out), data);
+        gtk_widget_hide(data->dialog->id);
+        gtk_widget_show(data->dialog->id_search);
+
+        select_identity(data, (PolkitIdentity*)def->data, FALSE);
+        data->fill_next = data->identities->next;
+        data->fill_source = g_idle_add(fill_identities, data);
+    }
+
+    /* With a compositing manager the window is simply translucent, otherwise
+     * get the background surface, reusing the last capture when it is still fresh. */
+    GdkScreen* screen = gtk_widget_get_screen(data->dialog->dlg);
+    int monitor = lxpolkit_backdrop_get_monitor(data->listener->backdrop);
+    GdkRectangle geometry;
+    GdkVisual* visual = NULL;
+    cairo_surface_t * backdrop = NULL;
+    if(lxpolkit_backdrop_use_overlay(data->listener->backdrop))
+        visual = gdk_screen_get_rgba_visual(screen);
+    else
+        backdrop = lxpolkit_backdrop_get_surface(data->listener->backdrop, monitor);
+    if(!visual)
+        visual = gdk_screen_get_system_visual(screen);
+    REQUEST_PROBE(data, backdrop_ready);
+    /* A pooled window keeps its visual; realize it again if the compositor came or went. */
+    if(gtk_widget_get_visual(data->dialog->dlg) != visual) {
+        gtk_widget_unrealize(data->dialog->dlg);
+        gtk_widget_set_visual(data->dialog->dlg, visual);
     }
-    return pixbuf;
+
+    /* Place the window over the whole monitor. */
+    gtk_window_fullscreen_on_monitor(GTK_WINDOW(data->dialog->dlg), screen, monitor);
+    gdk_screen_get_monitor_geometry(screen, monitor, &geometry);
+    gtk_window_move(GTK_WINDOW(data->dialog->dlg), geometry.x, geometry.y);
+    gtk_window_set_default_size(GTK_WINDOW(data->dialog->dlg), geometry.width, geometry.height);
+    if(backdrop)
+        lxpolkit_backdrop_set_origin(backdrop, geometry.x, geometry.y);
+    show_shades(data->listener, screen, monitor, visual);
+    /* The window holds its own reference, so invalidating the cache cannot pull the surface from under it. */
+    g_signal_connect_data(G_OBJECT(data->dialog->dlg), "draw", G_CALLBACK(draw), cairo_surface_reference(backdrop), (GClosureNotify)cairo_surface_destroy, 0);
+
+    gtk_label_set_text(GTK_LABEL(data->dialog->msg), data->message);
+    g_signal_connect(data->dialog->auth_button, "clicked", G_CALLBACK(auth_clicked), data);
+    g_signal_connect(data->dialog->cancel_button, "clicked", G_CALLBACK(cancel_clicked), data);
+    g_signal_connect(data->dialog->dlg, "map-event", G_CALLBACK(on_map_event), data);
+    g_signal_connect_after(data->dialog->dlg, "draw", G_CALLBACK(on_first_frame), data);
+
+    /* Show everything. */
+    update_queue_label(data->listener);
+    gtk_widget_show(data->dialog->dlg);
+    gtk_widget_grab_focus (data->dialog->request);
+    lxpolkit_agent_trace("dialog shown");
+    if(data->listener->trimmed) {
+        char* phase = g_strdup_printf("first dialog after trimming shown %" G_GINT64_FORMAT " us after the request",
+                                      g_get_monotonic_time() - data->start);
+        lxpolkit_agent_trace(phase);
+        g_free(phase);
+        data->listener->trimmed = FALSE;
+    }
+    DEBUG("dialog shown in %" G_GINT64_FORMAT " us", g_get_monotonic_time() - start);
 }
 
 /* Handler for "expose_event" on background. */
-gboolean draw(GtkWidget * widget, cairo_t * cr, GdkPixbuf * pixbuf) {
-    if (pixbuf != NULL) {
-        /* Copy the appropriate rectangle of the root window pixmap to the drawing area.
-         * All drawing areas are immediate children of the toplevel window, so the allocation yields the source coordinates directly. */
-        gdk_cairo_set_source_pixbuf (cr,  pixbuf, 0, 0);
-        cairo_paint (cr);
-    }
+gboolean draw(GtkWidget * widget, cairo_t * cr, cairo_surface_t * surface) {
+#ifdef G_ENABLE_DEBUG
+    gint64 start = g_get_monotonic_time();
+    GdkRectangle clip;
+#endif
+    /* GTK+ clips cr to the damaged region, so a spinner tick only copies its own rectangle. */
+    lxpolkit_backdrop_paint(cr, widget, surface);
+#ifdef G_ENABLE_DEBUG
+    if (gdk_cairo_get_clip_rectangle(cr, &clip))
+        DEBUG("draw: %dx%d+%d+%d in %" G_GINT64_FORMAT " us", clip.width, clip.height, clip.x, clip.y, g_get_monotonic_time() - start);
+#endif
+    return FALSE;
+}
+
+static gboolean on_map_event(GtkWidget* widget, GdkEvent* event, DlgData* data) {
+    REQUEST_PROBE(data, window_mapped);
+    lxpolkit_stats_prompt_shown(g_get_monotonic_time() - data->start);
+    g_signal_handlers_disconnect_by_func(widget, on_map_event, data);
+    return FALSE;
+}
+
+static gboolean on_first_frame(GtkWidget* widget, cairo_t* cr, DlgData* data) {
+    REQUEST_PROBE(data, first_frame);
+    g_signal_handlers_disconnect_by_func(widget, on_first_frame, data);
     return FALSE;
 }
 
 /* Handler for "clicked" signal on Cancel button. */
-static void cancel_clicked(GtkButton * button, GtkWidget *info, DlgData *data) {
-    dlg_data_free(data);
+static void cancel_clicked(GtkButton * button, DlgData *data) {
     g_cancellable_cancel(data->cancellable);
 }
 
-static void auth_clicked(GtkButton * button, GtkWidget *info, DlgData *data) {
-    gtk_widget_set_sensitive(data->auth_button, FALSE);
-    gtk_widget_show(data->auth_spin);
-    gtk_spinner_start (GTK_SPINNER (data->auth_spin));
-    const char* request = gtk_entry_get_text(GTK_ENTRY (data->request));
-    polkit_agent_session_response(data->session, request);
+static void auth_clicked(GtkButton * button, DlgData *data) {
+    GSList* l;
+    if(data->search_edited)
+        return;
+    /* the requests the window lists as answered by this password too */
+    g_slist_free_full(data->group, g_free);
+    data->group = find_group(data);
+    for(l = data->group; l; l = l->next)
+        l->data = g_strdup(((DlgData*)l->data)->cookie);
+    gtk_widget_set_sensitive(data->dialog->auth_button, FALSE);
+    gtk_widget_show(data->dialog->auth_spin);
+    gtk_spinner_start (GTK_SPINNER (data->dialog->auth_spin));
+    const char* request = gtk_entry_get_text(GTK_ENTRY (data->dialog->request));
+    free_secret(data->response);
+    data->response = g_strdup(request);
+    ++data->responses;
+    lxpolkit_session_manager_respond(data->sessions, request);
+    REQUEST_PROBE(data, response_sent);
 }
 
 static gboolean initiate_authentication_finish(PolkitAgentListener  *listener,
@@ -480,14 +1076,57 @@ static void lxpolkit_listener_finalize(GObject *object) {
 	g_return_if_fail(IS_LXPOLKIT_LISTENER(object));
 
 	self = LXPOLKIT_LISTENER(object);
+	lxpolkit_backdrop_free(self->backdrop);
+	if(--n_listeners == 0) {
+		lxpolkit_identity_cache_free(shared_identities);
+		shared_identities = NULL;
+		lxpolkit_notify_shutdown();
+	}
+	g_free(self->display_name);
+	g_free(self->xauthority);
+	if(self->last_identity)
+		g_object_unref(self->last_identity);
+	g_slist_free_full(self->idle_dialogs, (GDestroyNotify)lxpolkit_dialog_free);
+	free_shades(self);
+	lxpolkit_request_queue_clear(&self->requests);
+	if(self->idle_source)
+		g_source_remove(self->idle_source);
+	forget_shared_response(self);
 
 	G_OBJECT_CLASS(lxpolkit_listener_parent_class)->finalize(object);
 }
 
 
+/* Runs from the main loop while the agent registers in a worker thread. */
+static gboolean register_application(gpointer user_data)
+{
+    GError* err = NULL;
+    if(g_application_register(polapp, NULL, &err)) {
+        lxpolkit_agent_trace("application registered");
+        if(!lxpolkit_stats_export(g_application_get_dbus_connection(polapp),
+                                  g_application_get_dbus_object_path(polapp), &err)) {
+            g_warning("Cannot export the statistics: %s", err->message);
+            g_error_free(err);
+        }
+    } else {
+        g_warning("Cannot register the application: %s", err->message);
+        g_error_free(err);
+    }
+    return FALSE;
+}
+
 static void lxpolkit_listener_init(LXPolkitListener *self) {
-    polapp = g_application_new("org.raspberrypi.system.polkit", G_APPLICATION_IS_SERVICE);
-    g_application_register (polapp, NULL, NULL);
+    self->backdrop = lxpolkit_backdrop_new();
+    if(n_listeners++ == 0)
+        shared_identities = lxpolkit_identity_cache_new();
+    self->identities = shared_identities;
+    lxpolkit_request_queue_init(&self->requests, run_next_request, self);
+    self->uid = -1;
+
+    if(!polapp) {
+        polapp = g_application_new("org.raspberrypi.system.polkit", G_APPLICATION_IS_SERVICE);
+        g_idle_add(register_application, NULL);
+    }
 }
 
 
@@ -25,6 +25,10 @@
 
 #define POLKIT_AGENT_I_KNOW_API_IS_SUBJECT_TO_CHANGE
 #include <polkitagent/polkitagent.h>
+#include "lxpolkit-backdrop.h"
+#include "lxpolkit-identity.h"
+#include "lxpolkit-queue.h"
+#include "lxpolkit-session.h"
 
 G_BEGIN_DECLS
 
@@ -44,6 +48,22 @@ typedef struct _LXPolkitListenerClass		LXPolkitListenerClass;
 struct _LXPolkitListener
 {
 	PolkitAgentListener parent;
+	char* display_name;			/* NULL for the display of the process */
+	char* xauthority;			/* X authority file for display_name, NULL for the one of the process */
+	GdkDisplay* display;		/* opened for the first request */
+	gint uid;					/* user of the session, -1 for the user of the process */
+	LXPolkitBackdrop* backdrop;
+	GSList* idle_dialogs;
+	GPtrArray* shades;			/* plain dim windows over the other monitors */
+	LXPolkitIdentityCache* identities;	/* shared by every listener */
+	PolkitIdentity* last_identity;
+	LXPolkitRequestQueue requests;	/* one is shown or answered at a time */
+	guint idle_trim;			/* minutes without requests before trimming, 0 for never */
+	guint idle_source;
+	gboolean trimmed;			/* the caches were dropped since the last request */
+	char* shared_response;		/* answer of the last request, for its group */
+	PolkitIdentity* shared_identity;
+	GSList* shared_cookies;		/* requests that waited when it was typed */
 };
 
 struct _LXPolkitListenerClass
@@ -54,6 +74,25 @@ struct _LXPolkitListenerClass
 GType lxpolkit_listener_get_type(void);
 PolkitAgentListener* lxpolkit_listener_new(void);
 
+/* Show the dialogs of this listener on the given X display, for an agent
+ * serving sessions other than its own. Call before the first request. */
+void lxpolkit_listener_set_display_name(LXPolkitListener* self, const char* display_name);
+
+/* Open the display given to lxpolkit_listener_set_display_name() with the
+ * X authority file of its session. Without it an X server refuses an
+ * agent serving another user's session. */
+void lxpolkit_listener_set_xauthority(LXPolkitListener* self, const char* xauthority);
+
+/* Offer uid first, instead of the user running the agent. */
+void lxpolkit_listener_set_user(LXPolkitListener* self, gint uid);
+
+/* Once no request came for the given number of minutes, drop the cached
+ * backdrop, dialogs and identity names and return free heap to the
+ * system. The next request builds them again. 0 disables trimming. */
+void lxpolkit_listener_set_idle_trim(LXPolkitListener* self, guint minutes);
+
+#define LXPOLKIT_IDLE_TRIM  5
+
 G_END_DECLS
 
 #endif /* __LX_POLKIT_LISTENER_H__ */
@@ -0,0 +1,577 @@
+/*
+ *      lxpolkit-load.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/* End-to-end load harness, run with "make load".
+ *
+ * It starts a private dbus-daemon, which stands in for both the system and
+ * the session bus, and an Xvfb unless --display is given. On that bus it
+ * plays the polkit authority: lxpolkit registers with it, and it sends
+ * bursts of BeginAuthentication calls, cancelling some of them, as polkitd
+ * would for a busy session.
+ *
+ * The agent runs in a user and mount namespace (unshare(1), which needs
+ * unprivileged user namespaces), where this program is bind mounted over
+ * polkit-agent-helper-1. Run as the helper, it answers the conversation
+ * by itself after --think-time, without PAM, so no password is typed into
+ * the dialog. A request whose cookie asks for it fails its first attempt.
+ *
+ * At the end it prints the time until completion and after a cancel, the
+ * times until the window was mapped from the statistics of the agent, and
+ * how much the resident set of the agent grew after the first burst. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define AUTHORITY_NAME      "org.freedesktop.PolicyKit1"
+#define AUTHORITY_PATH      "/org/freedesktop/PolicyKit1/Authority"
+#define AUTHORITY_INTERFACE "org.freedesktop.PolicyKit1.Authority"
+#define AGENT_INTERFACE     "org.freedesktop.PolicyKit1.AuthenticationAgent"
+#define STATS_NAME          "org.raspberrypi.system.polkit"
+#define STATS_PATH          "/org/raspberrypi/system/polkit"
+#define STATS_INTERFACE     "org.raspberrypi.system.polkit.Stats"
+
+/* set for the agent, so this program knows when it runs as the helper */
+#define HELPER_ENV          "LXPOLKIT_LOAD_HELPER"
+#define THINK_ENV           "LXPOLKIT_LOAD_THINK"
+
+/* where polkit-agent-1 may look for its helper */
+static const char* helper_paths[] = {
+    "/usr/lib/polkit-1/polkit-agent-helper-1",
+    "/usr/libexec/polkit-agent-helper-1",
+    "/usr/libexec/polkit-1/polkit-agent-helper-1",
+    "/usr/lib/policykit-1/polkit-agent-helper-1",
+    NULL
+};
+
+static char* agent_path = "./lxpolkit";
+static char* helper_path = NULL;
+static char* display = NULL;
+static gint n_requests = 2000;
+static gint burst = 8;
+static gint n_identities = 3;
+static gint think_time = 20;
+static gint cancel_every = 10;
+static gint cancel_after = 5;
+static gint fail_every = 7;
+static gboolean json = FALSE;
+
+static GOptionEntry option_entries[] =
+{
+    { "agent", 0, 0, G_OPTION_ARG_FILENAME, &agent_path, "The lxpolkit binary to load", "PATH" },
+    { "helper-path", 0, 0, G_OPTION_ARG_FILENAME, &helper_path, "Where polkit-agent-1 looks for polkit-agent-helper-1", "PATH" },
+    { "display", 0, 0, G_OPTION_ARG_STRING, &display, "Use this X display instead of starting Xvfb", "DISPLAY" },
+    { "requests", 0, 0, G_OPTION_ARG_INT, &n_requests, "Requests to send in total", "N" },
+    { "burst", 0, 0, G_OPTION_ARG_INT, &burst, "Requests sent at once", "N" },
+    { "identities", 0, 0, G_OPTION_ARG_INT, &n_identities, "Identities offered by each request", "N" },
+    { "think-time", 0, 0, G_OPTION_ARG_INT, &think_time, "Time the helper takes to answer, in ms", "MS" },
+    { "cancel-every", 0, 0, G_OPTION_ARG_INT, &cancel_every, "Cancel every Nth request, 0 for none", "N" },
+    { "cancel-after", 0, 0, G_OPTION_ARG_INT, &cancel_after, "Time after which a request is cancelled, in ms", "MS" },
+    { "fail-every", 0, 0, G_OPTION_ARG_INT, &fail_every, "Fail the first attempt of every Nth request, 0 for none", "N" },
+    { "json", 0, 0, G_OPTION_ARG_NONE, &json, "Print the results as a JSON object", NULL },
+    { NULL }
+};
+
+static const char authority_xml[] =
+    "<node>"
+    "  <interface name='" AUTHORITY_INTERFACE "'>"
+    "    <method name='RegisterAuthenticationAgent'>"
+    "      <arg type='(sa{sv})' direction='in'/>"
+    "      <arg type='s' direction='in'/>"
+    "      <arg type='s' direction='in'/>"
+    "    </method>"
+    "    <method name='RegisterAuthenticationAgentWithOptions'>"
+    "      <arg type='(sa{sv})' direction='in'/>"
+    "      <arg type='s' direction='in'/>"
+    "      <arg type='s' direction='in'/>"
+    "      <arg type='a{sv}' direction='in'/>"
+    "    </method>"
+    "    <method name='UnregisterAuthenticationAgent'>"
+    "      <arg type='(sa{sv})' direction='in'/>"
+    "      <arg type='s' direction='in'/>"
+    "    </method>"
+    "    <property name='BackendName' type='s' access='read'/>"
+    "    <property name='BackendVersion' type='s' access='read'/>"
+    "    <property name='BackendFeatures' type='u' access='read'/>"
+    "  </interface>"
+    "</node>";
+
+typedef struct _LoadRequest LoadRequest;
+struct _LoadRequest
+{
+    char* cookie;
+    gint64 start;
+    gint64 cancelled;           /* when it was cancelled, 0 if it was not */
+    guint cancel_source;
+};
+
+static GMainLoop* loop;
+static GDBusConnection* bus;
+static GPid agent_pid;
+static char* agent_name;        /* unique bus name of the registered agent */
+static char* agent_object;
+static guint register_timeout;  /* gives up if the agent does not register */
+static int sent, in_flight, errors;
+static GArray* completion;      /* latencies in us */
+static GArray* cancellation;
+static long rss_baseline = -1;
+static int baseline_requests;
+
+/* As the helper: read the cookie, answer, and report the outcome. */
+static int run_helper(int argc, char** argv, const char* state_dir)
+{
+    char line[256];
+    const char* think = g_getenv(THINK_ENV);
+    char* cookie, *marker;
+    gboolean fail = FALSE;
+
+    /* newer polkit passes the cookie on stdin */
+    if(argc > 2)
+        cookie = g_strdup(argv[2]);
+    else if(fgets(line, sizeof(line), stdin))
+        cookie = g_strdup(g_strstrip(line));
+    else
+        return 1;
+
+    if(strstr(cookie, "-fail")) {
+        /* only the first helper of the request fails */
+        int fd;
+        marker = g_build_filename(state_dir, cookie, NULL);
+        fd = open(marker, O_CREAT | O_EXCL | O_WRONLY, 0600);
+        if(fd >= 0) {
+            close(fd);
+            fail = TRUE;
+        }
+        g_free(marker);
+    }
+    g_usleep((think ? atoi(think) : 0) * 1000);
+    fputs("PAM_TEXT_INFO Answered by the load harness\n", stdout);
+    fputs(fail ? "FAILURE\n" : "SUCCESS\n", stdout);
+    fflush(stdout);
+    g_free(cookie);
+    return 0;
+}
+
+/* VmRSS of a process, in kB, or -1. */
+static long get_rss(GPid pid)
+{
+    char* path = g_strdup_printf("/proc/%d/status", (int)pid);
+    char line[128];
+    long rss = -1;
+    FILE* f = fopen(path, "r");
+    g_free(path);
+    if(!f)
+        return -1;
+    while(fgets(line, sizeof(line), f))
+        if(sscanf(line, "VmRSS: %ld", &rss) == 1)
+            break;
+    fclose(f);
+    return rss;
+}
+
+static void load_request_free(LoadRequest* req)
+{
+    if(req->cancel_source)
+        g_source_remove(req->cancel_source);
+    g_free(req->cookie);
+    g_slice_free(LoadRequest, req);
+}
+
+static gboolean cancel_request(gpointer user_data)
+{
+    LoadRequest* req = (LoadRequest*)user_data;
+    req->cancel_source = 0;
+    req->cancelled = g_get_monotonic_time();
+    g_dbus_connection_call(bus, agent_name, agent_object, AGENT_INTERFACE, "CancelAuthentication",
+                           g_variant_new("(s)", req->cookie), NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+    return FALSE;
+}
+
+static void send_burst(void);
+
+static void on_reply(GObject* source, GAsyncResult* res, gpointer user_data)
+{
+    LoadRequest* req = (LoadRequest*)user_data;
+    GError* err = NULL;
+    GVariant* ret = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &err);
+    gint64 now = g_get_monotonic_time(), latency;
+
+    if(req->cancelled) {
+        /* a cancelled request may fail or not, the agent just has to let go */
+        latency = now - req->cancelled;
+        g_array_append_val(cancellation, latency);
+    } else if(ret) {
+        latency = now - req->start;
+        g_array_append_val(completion, latency);
+    } else {
+        g_printerr("request %s failed: %s\n", req->cookie, err->message);
+        ++errors;
+    }
+    if(ret)
+        g_variant_unref(ret);
+    if(err)
+        g_error_free(err);
+    load_request_free(req);
+
+    if(--in_flight == 0) {
+        if(rss_baseline < 0) {
+            /* the first burst fills the caches of the agent */
+            rss_baseline = get_rss(agent_pid);
+            baseline_requests = sent;
+        }
+        if(sent < n_requests)
+            send_burst();
+        else
+            g_main_loop_quit(loop);
+    }
+}
+
+static GVariant* make_identities(void)
+{
+    GVariantBuilder builder;
+    int i;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(sa{sv})"));
+    for(i = 0; i < n_identities; ++i) {
+        GVariantBuilder details;
+        g_variant_builder_init(&details, G_VARIANT_TYPE_VARDICT);
+        g_variant_builder_add(&details, "{sv}", "uid", g_variant_new_uint32(i == 0 ? 0 : 60000 + i));
+        g_variant_builder_add(&builder, "(s@a{sv})", "unix-user", g_variant_builder_end(&details));
+    }
+    return g_variant_builder_end(&builder);
+}
+
+/* Send the next burst of requests at once, like several programs asking
+ * at the same time. */
+static void send_burst(void)
+{
+    int i;
+    for(i = 0; i < burst && sent < n_requests; ++i, ++sent) {
+        LoadRequest* req = g_slice_new0(LoadRequest);
+        gboolean fail = fail_every > 0 && sent % fail_every == fail_every - 1;
+        req->cookie = g_strdup_printf("load-%d%s", sent, fail ? "-fail" : "");
+        req->start = g_get_monotonic_time();
+        if(cancel_every > 0 && sent % cancel_every == cancel_every - 1)
+            req->cancel_source = g_timeout_add(cancel_after, cancel_request, req);
+        g_dbus_connection_call(bus, agent_name, agent_object, AGENT_INTERFACE, "BeginAuthentication",
+                               g_variant_new("(sss@a{ss}s@a(sa{sv}))",
+                                             "org.lxde.lxpolkit.load", "The load harness wants to do something",
+                                             "dialog-password", g_variant_new_array(G_VARIANT_TYPE("{ss}"), NULL, 0),
+                                             req->cookie, make_identities()),
+                               NULL, G_DBUS_CALL_FLAGS_NONE, G_MAXINT, NULL, on_reply, req);
+        ++in_flight;
+    }
+}
+
+static void authority_method_call(GDBusConnection* connection, const gchar* sender, const gchar* object_path,
+                                  const gchar* interface_name, const gchar* method_name, GVariant* parameters,
+                                  GDBusMethodInvocation* invocation, gpointer user_data)
+{
+    if(g_str_has_prefix(method_name, "RegisterAuthenticationAgent")) {
+        const char* path;
+        g_variant_get_child(parameters, 2, "&s", &path);
+        g_dbus_method_invocation_return_value(invocation, NULL);
+        if(agent_name)
+            return;
+        agent_name = g_strdup(sender);
+        /* the run itself may take much longer */
+        if(register_timeout) {
+            g_source_remove(register_timeout);
+            register_timeout = 0;
+        }
+        agent_object = g_strdup(path);
+        if(!json)
+            printf("agent %s registered at %s\n", agent_name, agent_object);
+        send_burst();
+    } else
+        g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static GVariant* authority_get_property(GDBusConnection* connection, const gchar* sender, const gchar* object_path,
+                                        const gchar* interface_name, const gchar* property_name,
+                                        GError** error, gpointer user_data)
+{
+    if(strcmp(property_name, "BackendName") == 0)
+        return g_variant_new_string("lxpolkit-load");
+    if(strcmp(property_name, "BackendVersion") == 0)
+        return g_variant_new_string(VERSION);
+    return g_variant_new_uint32(0);
+}
+
+static const GDBusInterfaceVTable authority_vtable = {
+    authority_method_call,
+    authority_get_property,
+    NULL
+};
+
+static gboolean on_register_timeout(gpointer user_data)
+{
+    register_timeout = 0;
+    g_printerr("the agent did not register\n");
+    g_main_loop_quit(loop);
+    return FALSE;
+}
+
+/* Start argv and return the first line it writes, the bus address of
+ * dbus-daemon or the display of Xvfb. */
+static GSubprocess* spawn_reading(const char* const* argv, char** line, GError** error)
+{
+    GSubprocess* proc = g_subprocess_newv(argv, G_SUBPROCESS_FLAGS_STDOUT_PIPE, error);
+    GDataInputStream* data;
+
+    if(!proc)
+        return NULL;
+    data = g_data_input_stream_new(g_subprocess_get_stdout_pipe(proc));
+    *line = g_data_input_stream_read_line(data, NULL, NULL, error);
+    g_object_unref(data);
+    if(!*line) {
+        if(error && !*error)
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s exited before it was ready", argv[0]);
+        g_subprocess_force_exit(proc);
+        g_object_unref(proc);
+        return NULL;
+    }
+    return proc;
+}
+
+static int compare_gint64(gconstpointer a, gconstpointer b)
+{
+    gint64 x = *(const gint64*)a, y = *(const gint64*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(GArray* samples, int p)
+{
+    if(!samples->len)
+        return 0;
+    return g_array_index(samples, gint64, MIN(samples->len - 1, samples->len * p / 100)) / 1000.0;
+}
+
+/* Upper bound in ms of the bucket holding percentile p of a histogram
+ * exported by the agent, where bucket i counts times below 2^i ms. */
+static guint histogram_percentile(GVariant* histogram, int p)
+{
+    gsize n, i;
+    const guint32* buckets = histogram ? g_variant_get_fixed_array(histogram, &n, sizeof(guint32)) : NULL;
+    guint64 total = 0, sum = 0;
+    for(i = 0; i < n && buckets; ++i)
+        total += buckets[i];
+    for(i = 0; i < n && buckets; ++i) {
+        sum += buckets[i];
+        if(total && sum * 100 >= total * p)
+            return 1u << i;
+    }
+    return 0;
+}
+
+static void report_latencies(const char* name, GArray* samples, gboolean last)
+{
+    g_array_sort(samples, compare_gint64);
+    if(json)
+        printf("  \"%s\": {\"count\": %u, \"p50_ms\": %.2f, \"p90_ms\": %.2f, \"p99_ms\": %.2f, \"max_ms\": %.2f}%s\n",
+               name, samples->len, percentile(samples, 50), percentile(samples, 90),
+               percentile(samples, 99), percentile(samples, 100), last ? "" : ",");
+    else
+        printf("%-14s %6u requests  p50 %8.2f ms  p90 %8.2f ms  p99 %8.2f ms  max %8.2f ms\n",
+               name, samples->len, percentile(samples, 50), percentile(samples, 90),
+               percentile(samples, 99), percentile(samples, 100));
+}
+
+static void report(void)
+{
+    GVariant* mapped = NULL;
+    GVariant* ret;
+    long rss = get_rss(agent_pid);
+    int measured = sent - baseline_requests;
+    double growth = rss >= 0 && rss_baseline >= 0 && measured > 0 ? (rss - rss_baseline) * 1000.0 / measured : 0;
+
+    ret = g_dbus_connection_call_sync(bus, STATS_NAME, STATS_PATH, "org.freedesktop.DBus.Properties", "Get",
+                                      g_variant_new("(ss)", STATS_INTERFACE, "PromptLatency"), G_VARIANT_TYPE("(v)"),
+                                      G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+    if(ret) {
+        g_variant_get(ret, "(v)", &mapped);
+        g_variant_unref(ret);
+    }
+
+    if(json) {
+        printf("{\n  \"requests\": %d,\n  \"errors\": %d,\n", sent, errors);
+        report_latencies("completion", completion, FALSE);
+        report_latencies("cancellation", cancellation, FALSE);
+        printf("  \"mapped\": {\"p50_below_ms\": %u, \"p90_below_ms\": %u, \"p99_below_ms\": %u},\n",
+               histogram_percentile(mapped, 50), histogram_percentile(mapped, 90), histogram_percentile(mapped, 99));
+        printf("  \"rss_kb\": {\"baseline\": %ld, \"final\": %ld, \"growth_per_1000\": %.1f}\n}\n",
+               rss_baseline, rss, growth);
+    } else {
+        printf("%d requests, %d errors\n", sent, errors);
+        report_latencies("completion", completion, FALSE);
+        report_latencies("cancellation", cancellation, TRUE);
+        printf("%-14s p50 < %u ms  p90 < %u ms  p99 < %u ms\n", "window mapped",
+               histogram_percentile(mapped, 50), histogram_percentile(mapped, 90), histogram_percentile(mapped, 99));
+        printf("%-14s %ld kB after the first burst, %ld kB at the end, %+.1f kB per 1000 requests\n",
+               "agent RSS", rss_baseline, rss, growth);
+    }
+    if(mapped)
+        g_variant_unref(mapped);
+}
+
+int main(int argc, char** argv)
+{
+    static const char mount_script[] =
+        "[ -S /run/polkit/agent-helper.socket ] && mount -t tmpfs tmpfs /run/polkit; "
+        "mount --bind \"$1\" \"$2\" && shift 2 && exec \"$@\"";
+    GOptionContext* context;
+    GError* err = NULL;
+    GSubprocess* dbus = NULL, *xvfb = NULL, *agent = NULL;
+    GSubprocessLauncher* launcher;
+    GDBusNodeInfo* info = NULL;
+    char* address = NULL, *state_dir = NULL, *self = NULL, *x_display = NULL;
+    const char* state = g_getenv(HELPER_ENV);
+    int status = 1, i;
+
+    if(state && g_str_has_suffix(argv[0], "polkit-agent-helper-1"))
+        return run_helper(argc, argv, state);
+
+    context = g_option_context_new("");
+    g_option_context_add_main_entries(context, option_entries, NULL);
+    if(!g_option_context_parse(context, &argc, &argv, &err)) {
+        g_printerr("Error: %s\n", err->message);
+        return 1;
+    }
+    g_option_context_free(context);
+    for(i = 0; !helper_path && helper_paths[i]; ++i)
+        if(g_file_test(helper_paths[i], G_FILE_TEST_EXISTS))
+            helper_path = (char*)helper_paths[i];
+    if(!helper_path) {
+        g_printerr("Error: polkit-agent-helper-1 not found, give its path with --helper-path\n");
+        return 1;
+    }
+    n_identities = MAX(n_identities, 1);
+    burst = MAX(burst, 1);
+
+    completion = g_array_new(FALSE, FALSE, sizeof(gint64));
+    cancellation = g_array_new(FALSE, FALSE, sizeof(gint64));
+    loop = g_main_loop_new(NULL, FALSE);
+
+    {
+        const char* dbus_argv[] = { "dbus-daemon", "--session", "--nofork", "--print-address=1", NULL };
+        dbus = spawn_reading(dbus_argv, &address, &err);
+    }
+    if(!dbus)
+        goto error;
+    bus = g_dbus_connection_new_for_address_sync(address, G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                                 G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION, NULL, NULL, &err);
+    if(!bus)
+        goto error;
+    info = g_dbus_node_info_new_for_xml(authority_xml, &err);
+    if(!info || !g_dbus_connection_register_object(bus, AUTHORITY_PATH, info->interfaces[0],
+                                                   &authority_vtable, NULL, NULL, &err))
+        goto error;
+    g_bus_own_name_on_connection(bus, AUTHORITY_NAME, G_BUS_NAME_OWNER_FLAGS_NONE, NULL, NULL, NULL, NULL);
+
+    if(display)
+        x_display = g_strdup(display);
+    else {
+        const char* xvfb_argv[] = { "Xvfb", "-displayfd", "1", "-screen", "0", "1920x1080x24", "-nolisten", "tcp", NULL };
+        char* n = NULL;
+        xvfb = spawn_reading(xvfb_argv, &n, &err);
+        if(!xvfb)
+            goto error;
+        x_display = g_strdup_printf(":%s", n);
+        g_free(n);
+    }
+
+    state_dir = g_dir_make_tmp("lxpolkit-load-XXXXXX", &err);
+    self = g_file_read_link("/proc/self/exe", &err);
+    if(!state_dir || !self)
+        goto error;
+    {
+        char* think = g_strdup_printf("%d", think_time);
+        const char* agent_argv[] = { "unshare", "--user", "--map-root-user", "--mount", "sh", "-c", mount_script, "sh",
+                                     self, helper_path, agent_path, "--session=load", NULL };
+        launcher = g_subprocess_launcher_new(G_SUBPROCESS_FLAGS_NONE);
+        g_subprocess_launcher_setenv(launcher, "DBUS_SYSTEM_BUS_ADDRESS", address, TRUE);
+        g_subprocess_launcher_setenv(launcher, "DBUS_SESSION_BUS_ADDRESS", address, TRUE);
+        g_subprocess_launcher_setenv(launcher, "DISPLAY", x_display, TRUE);
+        g_subprocess_launcher_setenv(launcher, HELPER_ENV, state_dir, TRUE);
+        g_subprocess_launcher_setenv(launcher, THINK_ENV, think, TRUE);
+        agent = g_subprocess_launcher_spawnv(launcher, agent_argv, &err);
+        g_object_unref(launcher);
+        g_free(think);
+    }
+    if(!agent)
+        goto error;
+    /* unshare and sh exec the agent, so it keeps the pid */
+    agent_pid = atoi(g_subprocess_get_identifier(agent));
+
+    register_timeout = g_timeout_add_seconds(30, on_register_timeout, NULL);
+    g_main_loop_run(loop);
+    if(agent_name) {
+        report();
+        status = errors ? 1 : 0;
+    }
+
+error:
+    if(err) {
+        g_printerr("Error: %s\n", err->message);
+        g_error_free(err);
+    }
+    if(agent) {
+        g_subprocess_force_exit(agent);
+        g_object_unref(agent);
+    }
+    if(xvfb) {
+        g_subprocess_force_exit(xvfb);
+        g_object_unref(xvfb);
+    }
+    if(bus)
+        g_object_unref(bus);
+    if(dbus) {
+        g_subprocess_force_exit(dbus);
+        g_object_unref(dbus);
+    }
+    if(info)
+        g_dbus_node_info_unref(info);
+    if(state_dir) {
+        GDir* dir = g_dir_open(state_dir, 0, NULL);
+        const char* name;
+        while(dir && (name = g_dir_read_name(dir))) {
+            char* path = g_build_filename(state_dir, name, NULL);
+            g_unlink(path);
+            g_free(path);
+        }
+        if(dir)
+            g_dir_close(dir);
+        g_rmdir(state_dir);
+    }
+    g_free(state_dir);
+    g_free(self);
+    g_free(address);
+    g_free(x_display);
+    g_array_free(completion, TRUE);
+    g_array_free(cancellation, TRUE);
+    g_main_loop_unref(loop);
+    return status;
+}
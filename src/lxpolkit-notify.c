@@ -0,0 +1,157 @@
+/*
+ *      lxpolkit-notify.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-notify.h"
+#include <glib/gi18n.h>
+
+#ifdef G_ENABLE_DEBUG
+#define DEBUG(...)  g_debug(__VA_ARGS__)
+#else
+#define DEBUG(...)
+#endif
+
+#define NOTIFY_ICON     "dialog-password-symbolic"
+/* intervals to wait for the application to register before giving up */
+#define NOTIFY_MAX_RETRIES  3
+
+typedef struct _NotifyKind NotifyKind;
+struct _NotifyKind
+{
+    const char* id;
+    guint pending;              /* outcomes not sent yet */
+    guint burst;                /* outcomes since the last quiet interval */
+    guint retries;              /* intervals waited for the registration */
+    guint source;               /* end of the interval since the last one sent */
+};
+
+static NotifyKind kinds[LXPOLKIT_NOTIFY_N_KINDS] = {
+    { "authorized" },
+    { "wrong-password" },
+    { "no-users" }
+};
+
+static GApplication* notify_app;
+static GIcon* icon;
+static guint interval = LXPOLKIT_NOTIFY_INTERVAL;
+static gboolean unregistered;   /* gave up waiting for the registration */
+
+static char* get_title(LXPolkitNotifyKind kind, guint n)
+{
+    switch(kind)
+    {
+    case LXPOLKIT_NOTIFY_AUTHORIZED:
+        return n == 1 ? g_strdup(_("Authenticated"))
+                      : g_strdup_printf(ngettext("%u action authorised", "%u actions authorised", n), n);
+    case LXPOLKIT_NOTIFY_WRONG_PASSWORD:
+        return n == 1 ? g_strdup(_("Wrong Password"))
+                      : g_strdup_printf(ngettext("%u wrong password", "%u wrong passwords", n), n);
+    default:
+        return n == 1 ? g_strdup(_("No Users Found"))
+                      : g_strdup_printf(ngettext("%u request without users", "%u requests without users", n), n);
+    }
+}
+
+static gboolean on_interval_end(gpointer user_data);
+
+/* Send what is pending of kind and hold the next ones back for the
+ * interval. */
+static void send_pending(LXPolkitNotifyKind kind)
+{
+    NotifyKind* k = &kinds[kind];
+    GNotification* notification;
+    char* title;
+
+    if(!g_application_get_is_registered(notify_app)) {
+        /* Nothing can be sent before the application is registered. Wait a
+         * few intervals for it, then drop the outcomes: without a session
+         * bus it never registers, and retrying would wake us up for ever. */
+        if(!unregistered && k->retries++ < NOTIFY_MAX_RETRIES)
+            k->source = g_timeout_add_seconds(MAX(interval, 1), on_interval_end, GINT_TO_POINTER(kind));
+        else {
+            DEBUG("application not registered, %u %s notifications dropped", k->pending, k->id);
+            unregistered = TRUE;
+            k->pending = 0;
+            k->burst = 0;
+        }
+        return;
+    }
+    unregistered = FALSE;
+    k->retries = 0;
+
+    title = get_title(kind, k->burst);
+    notification = g_notification_new(title);
+    if(!icon)
+        icon = g_themed_icon_new(NOTIFY_ICON);
+    g_notification_set_icon(notification, icon);
+    g_application_send_notification(notify_app, k->id, notification);
+    g_object_unref(notification);
+    DEBUG("notification %s: %s", k->id, title);
+    g_free(title);
+    k->pending = 0;
+    if(interval)
+        k->source = g_timeout_add_seconds(interval, on_interval_end, GINT_TO_POINTER(kind));
+    else
+        k->burst = 0;
+}
+
+static gboolean on_interval_end(gpointer user_data)
+{
+    LXPolkitNotifyKind kind = (LXPolkitNotifyKind)GPOINTER_TO_INT(user_data);
+    kinds[kind].source = 0;
+    /* a quiet interval ends the burst; the next outcome goes out at once */
+    if(kinds[kind].pending)
+        send_pending(kind);
+    else
+        kinds[kind].burst = 0;
+    return FALSE;
+}
+
+void lxpolkit_notify(GApplication* app, LXPolkitNotifyKind kind)
+{
+    notify_app = app;
+    ++kinds[kind].pending;
+    ++kinds[kind].burst;
+    if(!kinds[kind].source)
+        send_pending(kind);
+}
+
+void lxpolkit_notify_set_interval(guint seconds)
+{
+    interval = seconds;
+}
+
+void lxpolkit_notify_shutdown(void)
+{
+    int i;
+    for(i = 0; i < LXPOLKIT_NOTIFY_N_KINDS; ++i) {
+        if(kinds[i].source)
+            g_source_remove(kinds[i].source);
+        kinds[i].source = 0;
+        kinds[i].pending = 0;
+        kinds[i].burst = 0;
+    }
+    if(icon) {
+        g_object_unref(icon);
+        icon = NULL;
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ *      lxpolkit-notify.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_NOTIFY_H__
+#define __LXPOLKIT_NOTIFY_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* Desktop notifications of the outcomes of all listeners. Each kind has a
+ * notification ID of its own, so a new one replaces the last one of the
+ * kind. At most one is sent per kind and interval; the outcomes in between
+ * are summed up in one notification at the end of the interval. */
+
+typedef enum
+{
+    LXPOLKIT_NOTIFY_AUTHORIZED,
+    LXPOLKIT_NOTIFY_WRONG_PASSWORD,
+    LXPOLKIT_NOTIFY_NO_USERS,
+    LXPOLKIT_NOTIFY_N_KINDS
+} LXPolkitNotifyKind;
+
+/* Report one outcome through the notifications of app. */
+void lxpolkit_notify(GApplication* app, LXPolkitNotifyKind kind);
+
+/* Seconds between two notifications of a kind, LXPOLKIT_NOTIFY_INTERVAL
+ * by default. 0 sends every outcome at once. */
+void lxpolkit_notify_set_interval(guint seconds);
+
+/* Drop the outcomes not sent yet and stop the timers. */
+void lxpolkit_notify_shutdown(void);
+
+#define LXPOLKIT_NOTIFY_INTERVAL    5
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_NOTIFY_H__ */
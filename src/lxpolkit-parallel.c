@@ -0,0 +1,120 @@
+/*
+ *      lxpolkit-parallel.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-parallel.h"
+
+#ifdef G_ENABLE_DEBUG
+#define DEBUG(...)  g_debug(__VA_ARGS__)
+#else
+#define DEBUG(...)
+#endif
+
+/* Jobs smaller than this are not worth waking up worker threads for. */
+#define PARALLEL_MIN_COST       (512 * 1024)
+#define PARALLEL_MAX_THREADS    4
+
+typedef struct _ParallelJob ParallelJob;
+struct _ParallelJob
+{
+    LXPolkitRangeFunc func;
+    gpointer user_data;
+    int pending;
+    GMutex lock;
+    GCond done;
+};
+
+typedef struct _ParallelRange ParallelRange;
+struct _ParallelRange
+{
+    ParallelJob* job;
+    int start;
+    int end;
+};
+
+static void parallel_worker(gpointer data, gpointer unused)
+{
+    ParallelRange* range = (ParallelRange*)data;
+    ParallelJob* job = range->job;
+    job->func(range->start, range->end, job->user_data);
+    g_mutex_lock(&job->lock);
+    if(--job->pending == 0)
+        g_cond_signal(&job->done);
+    g_mutex_unlock(&job->lock);
+}
+
+static int n_threads = 1;
+
+static gpointer parallel_create_pool(gpointer unused)
+{
+    GThreadPool* pool = NULL;
+    n_threads = MIN(g_get_num_processors(), PARALLEL_MAX_THREADS);
+    if(n_threads > 1)
+        pool = g_thread_pool_new(parallel_worker, NULL, n_threads - 1, FALSE, NULL);
+    if(!pool)
+        n_threads = 1;
+    DEBUG("worker threads: %d", n_threads);
+    return pool;
+}
+
+void lxpolkit_parallel_for(int n, gsize cost, LXPolkitRangeFunc func, gpointer user_data)
+{
+    static GOnce pool_once = G_ONCE_INIT;
+    GThreadPool* pool;
+    ParallelRange ranges[PARALLEL_MAX_THREADS];
+    ParallelJob job;
+    int n_ranges, step, i;
+
+    if(n <= 0)
+        return;
+
+    pool = (GThreadPool*)g_once(&pool_once, parallel_create_pool, NULL);
+    n_ranges = (cost < PARALLEL_MIN_COST) ? 1 : MIN(n_threads, n);
+    if(n_ranges == 1) {
+        func(0, n, user_data);
+        return;
+    }
+
+    job.func = func;
+    job.user_data = user_data;
+    step = (n + n_ranges - 1) / n_ranges;
+    for(i = 0; i < n_ranges; ++i) {
+        ranges[i].job = &job;
+        ranges[i].start = MIN(i * step, n);
+        ranges[i].end = MIN(ranges[i].start + step, n);
+    }
+
+    /* hand all ranges but the first to the pool and do the first one here. */
+    job.pending = n_ranges - 1;
+    g_mutex_init(&job.lock);
+    g_cond_init(&job.done);
+    for(i = 1; i < n_ranges; ++i)
+        g_thread_pool_push(pool, &ranges[i], NULL);
+    func(ranges[0].start, ranges[0].end, user_data);
+
+    g_mutex_lock(&job.lock);
+    while(job.pending > 0)
+        g_cond_wait(&job.done, &job.lock);
+    g_mutex_unlock(&job.lock);
+    g_mutex_clear(&job.lock);
+    g_cond_clear(&job.done);
+}
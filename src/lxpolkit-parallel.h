@@ -0,0 +1,37 @@
+/*
+ *      lxpolkit-parallel.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_PARALLEL_H__
+#define __LXPOLKIT_PARALLEL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef void (*LXPolkitRangeFunc)(int start, int end, gpointer user_data);
+
+/* Split [0, n) into one range per worker thread and run func on each, one
+ * of them on the calling thread, returning once all are done. cost is the
+ * number of bytes the whole job touches; small jobs run in one piece. */
+void lxpolkit_parallel_for(int n, gsize cost, LXPolkitRangeFunc func, gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_PARALLEL_H__ */
@@ -0,0 +1,72 @@
+/*
+ *      lxpolkit-probes.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_PROBES_H__
+#define __LXPOLKIT_PROBES_H__
+
+#include <glib.h>
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+G_BEGIN_DECLS
+
+/* Static tracepoints along the life of a request, in this order:
+ *
+ *   request_received   polkitd asked for authentication
+ *   identities_named   the names of all offered identities are known
+ *   backdrop_ready     the backdrop is captured and dimmed, or not needed
+ *   window_mapped      the window is on screen
+ *   first_frame        the window drew for the first time
+ *   helper_request     the helper asked a question
+ *   response_sent      an answer went to the helper
+ *   completed          the helper finished
+ *
+ * With <sys/sdt.h> each one is a USDT probe of the provider lxpolkit with
+ * the cookie and the action ID as its arguments, e.g. for bpftrace
+ *
+ *   usdt:/usr/libexec/lxpolkit:lxpolkit:first_frame { printf("%s\n", str(arg1)); }
+ *
+ * and costs a nop while nothing is attached. Debug builds also log each
+ * one with the time since the request came in. */
+
+#ifdef HAVE_SYS_SDT_H
+#define LXPOLKIT_SDT(name, cookie, action_id)   DTRACE_PROBE2(lxpolkit, name, cookie, action_id)
+#else
+#define LXPOLKIT_SDT(name, cookie, action_id)
+#endif
+
+#ifdef G_ENABLE_DEBUG
+#define LXPOLKIT_TIMELINE(name, cookie, action_id, start) \
+    g_debug("request %s (%s): %-16s +%8.2f ms", cookie, action_id, #name, \
+            (g_get_monotonic_time() - (start)) / 1000.0)
+#else
+#define LXPOLKIT_TIMELINE(name, cookie, action_id, start)
+#endif
+
+/* start is the monotonic time the request came in. */
+#define LXPOLKIT_PROBE(name, cookie, action_id, start) G_STMT_START { \
+    LXPOLKIT_SDT(name, cookie, action_id); \
+    LXPOLKIT_TIMELINE(name, cookie, action_id, start); \
+} G_STMT_END
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_PROBES_H__ */
@@ -0,0 +1,87 @@
+/*
+ *      lxpolkit-queue.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-queue.h"
+
+/* The next request starts from the main loop, never from inside the
+ * callbacks that finished the last one. */
+static gboolean run_next_request(gpointer user_data)
+{
+    LXPolkitRequestQueue* queue = (LXPolkitRequestQueue*)user_data;
+    queue->next_source = 0;
+    if(!queue->current)
+        queue->run(queue, queue->user_data);
+    return FALSE;
+}
+
+static void schedule_next_request(LXPolkitRequestQueue* queue)
+{
+    if(!queue->next_source)
+        queue->next_source = g_idle_add(run_next_request, queue);
+}
+
+void lxpolkit_request_queue_init(LXPolkitRequestQueue* queue, LXPolkitRequestQueueFunc run, gpointer user_data)
+{
+    queue->current = NULL;
+    g_queue_init(&queue->waiting);
+    queue->next_source = 0;
+    queue->run = run;
+    queue->user_data = user_data;
+}
+
+void lxpolkit_request_queue_clear(LXPolkitRequestQueue* queue)
+{
+    if(queue->next_source) {
+        g_source_remove(queue->next_source);
+        queue->next_source = 0;
+    }
+    g_queue_clear(&queue->waiting);
+    queue->current = NULL;
+}
+
+void lxpolkit_request_queue_push(LXPolkitRequestQueue* queue, gpointer request)
+{
+    g_queue_push_tail(&queue->waiting, request);
+    schedule_next_request(queue);
+}
+
+gboolean lxpolkit_request_queue_remove(LXPolkitRequestQueue* queue, gpointer request)
+{
+    if(queue->current == request) {
+        queue->current = NULL;
+        schedule_next_request(queue);
+        return FALSE;
+    }
+    return g_queue_remove(&queue->waiting, request);
+}
+
+gpointer lxpolkit_request_queue_pop(LXPolkitRequestQueue* queue, GList* link)
+{
+    if(!link)
+        link = queue->waiting.head;
+    if(!link)
+        return NULL;
+    queue->current = link->data;
+    g_queue_delete_link(&queue->waiting, link);
+    return queue->current;
+}
@@ -0,0 +1,63 @@
+/*
+ *      lxpolkit-queue.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_QUEUE_H__
+#define __LXPOLKIT_QUEUE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The requests of a listener, which asks one at a time. The others wait
+ * in the order they came in until the current one is removed. */
+typedef struct _LXPolkitRequestQueue LXPolkitRequestQueue;
+
+/* Called from the main loop once no request is current. It starts the
+ * next one with lxpolkit_request_queue_pop(), or leaves the queue idle. */
+typedef void (*LXPolkitRequestQueueFunc)(LXPolkitRequestQueue* queue, gpointer user_data);
+
+struct _LXPolkitRequestQueue
+{
+    gpointer current;           /* the request being asked */
+    GQueue waiting;             /* requests waiting for their turn */
+    guint next_source;
+    LXPolkitRequestQueueFunc run;
+    gpointer user_data;
+};
+
+void lxpolkit_request_queue_init(LXPolkitRequestQueue* queue, LXPolkitRequestQueueFunc run, gpointer user_data);
+
+/* Forget the requests without freeing them. */
+void lxpolkit_request_queue_clear(LXPolkitRequestQueue* queue);
+
+/* Append request and run the queue if it is idle. */
+void lxpolkit_request_queue_push(LXPolkitRequestQueue* queue, gpointer request);
+
+/* Take request out of the queue. If it was the current one, the queue runs
+ * again. Returns TRUE if it was waiting. */
+gboolean lxpolkit_request_queue_remove(LXPolkitRequestQueue* queue, gpointer request);
+
+/* Make the waiting request in link, or the first one if link is NULL, the
+ * current one and return it. Returns NULL if none is waiting. */
+gpointer lxpolkit_request_queue_pop(LXPolkitRequestQueue* queue, GList* link);
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_QUEUE_H__ */
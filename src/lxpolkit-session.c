@@ -0,0 +1,223 @@
+/*
+ *      lxpolkit-session.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-session.h"
+
+#ifdef G_ENABLE_DEBUG
+#define DEBUG(...)  g_debug(__VA_ARGS__)
+#else
+#define DEBUG(...)
+#endif
+
+/* One polkit-agent-helper-1 process. */
+typedef struct _HelperSession HelperSession;
+struct _HelperSession
+{
+    LXPolkitSessionManager* manager;
+    PolkitAgentSession* session;
+    gint64 spawned;         /* monotonic time the helper was started */
+    gboolean prompted;      /* the helper asked its first question */
+};
+
+struct _LXPolkitSessionManager
+{
+    char* cookie;
+    const LXPolkitSessionFuncs* funcs;
+    gpointer user_data;
+    PolkitIdentity* identity;   /* the selected identity */
+    HelperSession* active;      /* the session shown to the user */
+    guint debounce_source;
+    gboolean cancelled;
+};
+
+static LXPolkitSessionStats stats;
+
+static void on_completed(PolkitAgentSession* session, gboolean authorized, HelperSession* helper);
+static void on_request(PolkitAgentSession* session, gchar* request, gboolean echo_on, HelperSession* helper);
+static void on_show_error(PolkitAgentSession* session, gchar* text, HelperSession* helper);
+static void on_show_info(PolkitAgentSession* session, gchar* text, HelperSession* helper);
+
+static HelperSession* helper_spawn(LXPolkitSessionManager* manager)
+{
+    HelperSession* helper = g_slice_new0(HelperSession);
+    helper->manager = manager;
+    helper->session = polkit_agent_session_new(manager->identity, manager->cookie);
+    g_signal_connect(helper->session, "completed", G_CALLBACK(on_completed), helper);
+    g_signal_connect(helper->session, "request", G_CALLBACK(on_request), helper);
+    g_signal_connect(helper->session, "show-error", G_CALLBACK(on_show_error), helper);
+    g_signal_connect(helper->session, "show-info", G_CALLBACK(on_show_info), helper);
+    helper->spawned = g_get_monotonic_time();
+    polkit_agent_session_initiate(helper->session);
+    ++stats.spawned;
+    DEBUG("helper %u spawned", stats.spawned);
+    return helper;
+}
+
+static void helper_free(HelperSession* helper)
+{
+    g_signal_handlers_disconnect_matched(helper->session, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, helper);
+    g_object_unref(helper->session);
+    g_slice_free(HelperSession, helper);
+}
+
+/* Stop a helper that was never used, without hearing its "completed". */
+static void helper_discard(HelperSession* helper)
+{
+    if(!helper)
+        return;
+    g_signal_handlers_disconnect_matched(helper->session, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, helper);
+    polkit_agent_session_cancel(helper->session);
+    ++stats.discarded;
+    helper_free(helper);
+}
+
+static void log_stats(void)
+{
+    DEBUG("helpers: %u spawned, %u for retries, %u discarded, first request after %" G_GINT64_FORMAT " us on average, %" G_GINT64_FORMAT " us at most",
+          stats.spawned, stats.retries, stats.discarded,
+          stats.prompted ? stats.prompt_latency / stats.prompted : 0, stats.max_prompt_latency);
+}
+
+static void on_completed(PolkitAgentSession* session, gboolean authorized, HelperSession* helper)
+{
+    LXPolkitSessionManager* manager = helper->manager;
+
+    manager->active = NULL;
+    helper_free(helper);
+    if(!authorized && !manager->cancelled) {
+        /* Start the helper of the retry before the failure is reported, so
+         * its fork and PAM setup happen while the user reads the message
+         * rather than after the next password is typed. Only one helper
+         * runs at a time, so PAM sees no conversation that is not used. */
+        manager->active = helper_spawn(manager);
+        ++stats.retries;
+    }
+    log_stats();
+    manager->funcs->completed(authorized, manager->user_data);
+}
+
+static void on_request(PolkitAgentSession* session, gchar* request, gboolean echo_on, HelperSession* helper)
+{
+    LXPolkitSessionManager* manager = helper->manager;
+    if(!helper->prompted) {
+        gint64 latency = g_get_monotonic_time() - helper->spawned;
+        helper->prompted = TRUE;
+        ++stats.prompted;
+        stats.prompt_latency += latency;
+        stats.max_prompt_latency = MAX(stats.max_prompt_latency, latency);
+        DEBUG("helper asked its first question after %" G_GINT64_FORMAT " us", latency);
+    }
+    if(helper == manager->active)
+        manager->funcs->request(request, echo_on, manager->user_data);
+}
+
+static void on_show_error(PolkitAgentSession* session, gchar* text, HelperSession* helper)
+{
+    if(helper == helper->manager->active)
+        helper->manager->funcs->show_error(text, helper->manager->user_data);
+}
+
+static void on_show_info(PolkitAgentSession* session, gchar* text, HelperSession* helper)
+{
+    if(helper == helper->manager->active)
+        helper->manager->funcs->show_info(text, helper->manager->user_data);
+}
+
+LXPolkitSessionManager* lxpolkit_session_manager_new(const char* cookie, const LXPolkitSessionFuncs* funcs, gpointer user_data)
+{
+    LXPolkitSessionManager* manager = g_slice_new0(LXPolkitSessionManager);
+    manager->cookie = g_strdup(cookie);
+    manager->funcs = funcs;
+    manager->user_data = user_data;
+    return manager;
+}
+
+void lxpolkit_session_manager_free(LXPolkitSessionManager* manager)
+{
+    if(!manager)
+        return;
+    if(manager->debounce_source)
+        g_source_remove(manager->debounce_source);
+    helper_discard(manager->active);
+    if(manager->identity)
+        g_object_unref(manager->identity);
+    g_free(manager->cookie);
+    g_slice_free(LXPolkitSessionManager, manager);
+}
+
+static gboolean on_debounce_timeout(gpointer user_data)
+{
+    LXPolkitSessionManager* manager = (LXPolkitSessionManager*)user_data;
+    manager->debounce_source = 0;
+    manager->active = helper_spawn(manager);
+    return FALSE;
+}
+
+void lxpolkit_session_manager_select(LXPolkitSessionManager* manager, PolkitIdentity* identity, gboolean debounce)
+{
+    helper_discard(manager->active);
+    manager->active = NULL;
+    if(manager->identity)
+        g_object_unref(manager->identity);
+    manager->identity = (PolkitIdentity*)g_object_ref(identity);
+
+    if(manager->debounce_source) {
+        g_source_remove(manager->debounce_source);
+        manager->debounce_source = 0;
+    }
+    if(debounce)
+        manager->debounce_source = g_timeout_add(LXPOLKIT_SESSION_DEBOUNCE, on_debounce_timeout, manager);
+    else
+        manager->active = helper_spawn(manager);
+}
+
+void lxpolkit_session_manager_respond(LXPolkitSessionManager* manager, const char* response)
+{
+    /* the user did not wait for the debounce */
+    if(manager->debounce_source) {
+        g_source_remove(manager->debounce_source);
+        on_debounce_timeout(manager);
+    }
+    if(!manager->active)
+        return;
+    polkit_agent_session_response(manager->active->session, response);
+}
+
+gboolean lxpolkit_session_manager_cancel(LXPolkitSessionManager* manager)
+{
+    if(manager->debounce_source) {
+        g_source_remove(manager->debounce_source);
+        manager->debounce_source = 0;
+    }
+    if(!manager->active)
+        return FALSE;
+    manager->cancelled = TRUE;
+    /* emits "completed", which may free the manager */
+    polkit_agent_session_cancel(manager->active->session);
+    return TRUE;
+}
+
+void lxpolkit_session_get_stats(LXPolkitSessionStats* out)
+{
+    *out = stats;
+}
@@ -0,0 +1,79 @@
+/*
+ *      lxpolkit-session.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_SESSION_H__
+#define __LXPOLKIT_SESSION_H__
+
+#define POLKIT_AGENT_I_KNOW_API_IS_SUBJECT_TO_CHANGE
+#include <polkitagent/polkitagent.h>
+
+G_BEGIN_DECLS
+
+/* Runs the polkit-agent-helper-1 sessions of one authentication request.
+ * Identity changes are debounced, so scrolling through identities does not
+ * start a helper per row. After a wrong password the helper of the retry
+ * is started at once, while the failure is shown. */
+typedef struct _LXPolkitSessionManager LXPolkitSessionManager;
+
+/* What the current session reports. After a failed attempt the manager
+ * already switched to a new session when completed is called. completed
+ * may free the manager. */
+typedef struct _LXPolkitSessionFuncs LXPolkitSessionFuncs;
+struct _LXPolkitSessionFuncs
+{
+    void (*completed)(gboolean authorized, gpointer user_data);
+    void (*request)(const char* request, gboolean echo_on, gpointer user_data);
+    void (*show_error)(const char* text, gpointer user_data);
+    void (*show_info)(const char* text, gpointer user_data);
+};
+
+LXPolkitSessionManager* lxpolkit_session_manager_new(const char* cookie, const LXPolkitSessionFuncs* funcs, gpointer user_data);
+void lxpolkit_session_manager_free(LXPolkitSessionManager* manager);
+
+/* Authenticate as identity, starting its helper now or, with debounce,
+ * once no other identity was selected for LXPOLKIT_SESSION_DEBOUNCE ms. */
+void lxpolkit_session_manager_select(LXPolkitSessionManager* manager, PolkitIdentity* identity, gboolean debounce);
+
+/* Answer the prompt of the current session. */
+void lxpolkit_session_manager_respond(LXPolkitSessionManager* manager, const char* response);
+
+/* Cancel the current session. Returns FALSE if there was none; otherwise
+ * completed is called with FALSE before it returns. */
+gboolean lxpolkit_session_manager_cancel(LXPolkitSessionManager* manager);
+
+#define LXPOLKIT_SESSION_DEBOUNCE   250
+
+/* Counters over all requests since the agent started. */
+typedef struct _LXPolkitSessionStats LXPolkitSessionStats;
+struct _LXPolkitSessionStats
+{
+    guint spawned;              /* helpers started */
+    guint retries;              /* helpers started after a failed attempt */
+    guint discarded;            /* helpers cancelled before they were used */
+    guint prompted;             /* helpers that reached their first request */
+    gint64 prompt_latency;      /* summed time from start to first request, in us */
+    gint64 max_prompt_latency;
+};
+
+void lxpolkit_session_get_stats(LXPolkitSessionStats* stats);
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_SESSION_H__ */
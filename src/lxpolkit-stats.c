@@ -0,0 +1,192 @@
+/*
+ *      lxpolkit-stats.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-stats.h"
+#include "lxpolkit-agent.h"
+#include "lxpolkit-session.h"
+#include <string.h>
+
+/* The counters only change in the main loop, so nothing is locked. */
+typedef struct _AgentStats AgentStats;
+struct _AgentStats
+{
+    guint32 requests;
+    GHashTable* by_action;          /* action ID -> requests, as GUINT_TO_POINTER */
+    guint32 outcomes[LXPOLKIT_OUTCOME_CANCELLED + 1];
+    guint32 wrong_answers;
+    guint32 prompt_latency[LXPOLKIT_STATS_BUCKETS];
+    guint32 completion_latency[LXPOLKIT_STATS_BUCKETS];
+    guint32 captures;
+    gint64 capture_time;
+    gint64 max_capture_time;
+};
+
+static AgentStats stats;
+
+/* Nothing signals the changes; the values are read when asked for. */
+static const char introspection_xml[] =
+    "<node>"
+    "  <interface name='" LXPOLKIT_STATS_INTERFACE "'>"
+    "    <annotation name='org.freedesktop.DBus.Property.EmitsChangedSignal' value='false'/>"
+    "    <property name='Requests' type='u' access='read'/>"
+    "    <property name='RequestsByAction' type='a{su}' access='read'/>"
+    "    <property name='Authorized' type='u' access='read'/>"
+    "    <property name='Failed' type='u' access='read'/>"
+    "    <property name='Cancelled' type='u' access='read'/>"
+    "    <property name='WrongAnswers' type='u' access='read'/>"
+    "    <property name='PromptLatency' type='au' access='read'/>"
+    "    <property name='CompletionLatency' type='au' access='read'/>"
+    "    <property name='HelpersSpawned' type='u' access='read'/>"
+    "    <property name='RetryHelpers' type='u' access='read'/>"
+    "    <property name='HelpersDiscarded' type='u' access='read'/>"
+    "    <property name='HelperPromptLatency' type='x' access='read'/>"
+    "    <property name='HelperPromptLatencyMax' type='x' access='read'/>"
+    "    <property name='BackdropCaptures' type='u' access='read'/>"
+    "    <property name='BackdropCaptureTime' type='x' access='read'/>"
+    "    <property name='BackdropCaptureTimeMax' type='x' access='read'/>"
+    "    <property name='ResidentSetSize' type='x' access='read'/>"
+    "  </interface>"
+    "</node>";
+
+static void histogram_add(guint32* buckets, gint64 latency)
+{
+    gint64 ms = latency / 1000;
+    int i = 0;
+    while(i < LXPOLKIT_STATS_BUCKETS - 1 && ms >= ((gint64)1 << i))
+        ++i;
+    ++buckets[i];
+}
+
+static GVariant* histogram_variant(const guint32* buckets)
+{
+    return g_variant_new_fixed_array(G_VARIANT_TYPE_UINT32, buckets, LXPOLKIT_STATS_BUCKETS, sizeof(guint32));
+}
+
+void lxpolkit_stats_request_received(const char* action_id)
+{
+    gpointer n;
+    if(!stats.by_action)
+        stats.by_action = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    ++stats.requests;
+    if(g_hash_table_lookup_extended(stats.by_action, action_id, NULL, &n))
+        g_hash_table_insert(stats.by_action, g_strdup(action_id), GUINT_TO_POINTER(GPOINTER_TO_UINT(n) + 1));
+    else
+        g_hash_table_insert(stats.by_action, g_strdup(action_id), GUINT_TO_POINTER(1));
+}
+
+void lxpolkit_stats_prompt_shown(gint64 latency)
+{
+    histogram_add(stats.prompt_latency, latency);
+}
+
+void lxpolkit_stats_wrong_answer(void)
+{
+    ++stats.wrong_answers;
+}
+
+void lxpolkit_stats_request_finished(LXPolkitOutcome outcome, gint64 latency)
+{
+    ++stats.outcomes[outcome];
+    histogram_add(stats.completion_latency, latency);
+}
+
+void lxpolkit_stats_backdrop_captured(gint64 duration)
+{
+    ++stats.captures;
+    stats.capture_time += duration;
+    stats.max_capture_time = MAX(stats.max_capture_time, duration);
+}
+
+static GVariant* get_property(GDBusConnection* connection, const gchar* sender, const gchar* object_path,
+                              const gchar* interface_name, const gchar* property_name,
+                              GError** error, gpointer user_data)
+{
+    LXPolkitSessionStats helpers;
+    lxpolkit_session_get_stats(&helpers);
+
+    if(strcmp(property_name, "Requests") == 0)
+        return g_variant_new_uint32(stats.requests);
+    if(strcmp(property_name, "RequestsByAction") == 0) {
+        GVariantBuilder builder;
+        GHashTableIter it;
+        gpointer action_id, n;
+        g_variant_builder_init(&builder, G_VARIANT_TYPE("a{su}"));
+        if(stats.by_action) {
+            g_hash_table_iter_init(&it, stats.by_action);
+            while(g_hash_table_iter_next(&it, &action_id, &n))
+                g_variant_builder_add(&builder, "{su}", (const char*)action_id, GPOINTER_TO_UINT(n));
+        }
+        return g_variant_builder_end(&builder);
+    }
+    if(strcmp(property_name, "Authorized") == 0)
+        return g_variant_new_uint32(stats.outcomes[LXPOLKIT_OUTCOME_AUTHORIZED]);
+    if(strcmp(property_name, "Failed") == 0)
+        return g_variant_new_uint32(stats.outcomes[LXPOLKIT_OUTCOME_FAILED]);
+    if(strcmp(property_name, "Cancelled") == 0)
+        return g_variant_new_uint32(stats.outcomes[LXPOLKIT_OUTCOME_CANCELLED]);
+    if(strcmp(property_name, "WrongAnswers") == 0)
+        return g_variant_new_uint32(stats.wrong_answers);
+    if(strcmp(property_name, "PromptLatency") == 0)
+        return histogram_variant(stats.prompt_latency);
+    if(strcmp(property_name, "CompletionLatency") == 0)
+        return histogram_variant(stats.completion_latency);
+    if(strcmp(property_name, "HelpersSpawned") == 0)
+        return g_variant_new_uint32(helpers.spawned);
+    if(strcmp(property_name, "RetryHelpers") == 0)
+        return g_variant_new_uint32(helpers.retries);
+    if(strcmp(property_name, "HelpersDiscarded") == 0)
+        return g_variant_new_uint32(helpers.discarded);
+    if(strcmp(property_name, "HelperPromptLatency") == 0)
+        return g_variant_new_int64(helpers.prompted ? helpers.prompt_latency / helpers.prompted : 0);
+    if(strcmp(property_name, "HelperPromptLatencyMax") == 0)
+        return g_variant_new_int64(helpers.max_prompt_latency);
+    if(strcmp(property_name, "BackdropCaptures") == 0)
+        return g_variant_new_uint32(stats.captures);
+    if(strcmp(property_name, "BackdropCaptureTime") == 0)
+        return g_variant_new_int64(stats.capture_time);
+    if(strcmp(property_name, "BackdropCaptureTimeMax") == 0)
+        return g_variant_new_int64(stats.max_capture_time);
+    if(strcmp(property_name, "ResidentSetSize") == 0)
+        return g_variant_new_int64(lxpolkit_agent_get_rss());
+
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "No property %s", property_name);
+    return NULL;
+}
+
+static const GDBusInterfaceVTable interface_vtable = {
+    NULL,
+    get_property,
+    NULL
+};
+
+gboolean lxpolkit_stats_export(GDBusConnection* connection, const char* object_path, GError** error)
+{
+    GDBusNodeInfo* info = g_dbus_node_info_new_for_xml(introspection_xml, error);
+    guint id;
+    if(!info)
+        return FALSE;
+    id = g_dbus_connection_register_object(connection, object_path, info->interfaces[0],
+                                           &interface_vtable, NULL, NULL, error);
+    g_dbus_node_info_unref(info);
+    return id != 0;
+}
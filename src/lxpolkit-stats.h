@@ -0,0 +1,64 @@
+/*
+ *      lxpolkit-stats.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_STATS_H__
+#define __LXPOLKIT_STATS_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* Counters over all requests of all listeners since the agent started,
+ * exported read-only as the properties of LXPOLKIT_STATS_INTERFACE, e.g.
+ *
+ *   gdbus call --session --dest org.raspberrypi.system.polkit \
+ *       --object-path /org/raspberrypi/system/polkit \
+ *       --method org.freedesktop.DBus.Properties.GetAll \
+ *       org.raspberrypi.system.polkit.Stats
+ *
+ * Latencies are kept as histograms of LXPOLKIT_STATS_BUCKETS buckets; the
+ * bucket i counts times below 2^i ms, the last one everything longer. */
+
+#define LXPOLKIT_STATS_INTERFACE    "org.raspberrypi.system.polkit.Stats"
+#define LXPOLKIT_STATS_BUCKETS      16
+
+typedef enum
+{
+    LXPOLKIT_OUTCOME_AUTHORIZED,
+    LXPOLKIT_OUTCOME_FAILED,        /* the request could not be asked */
+    LXPOLKIT_OUTCOME_CANCELLED
+} LXPolkitOutcome;
+
+/* The times are in us since the request came in; a prompt counts as shown
+ * once its window is mapped. */
+void lxpolkit_stats_request_received(const char* action_id);
+void lxpolkit_stats_prompt_shown(gint64 latency);
+void lxpolkit_stats_wrong_answer(void);
+void lxpolkit_stats_request_finished(LXPolkitOutcome outcome, gint64 latency);
+
+/* duration of one backdrop capture, in us */
+void lxpolkit_stats_backdrop_captured(gint64 duration);
+
+/* Register the interface at object_path. Call once. */
+gboolean lxpolkit_stats_export(GDBusConnection* connection, const char* object_path, GError** error);
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_STATS_H__ */
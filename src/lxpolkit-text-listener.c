@@ -0,0 +1,517 @@
+/*
+ *      lxpolkit-text-listener.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "lxpolkit-text-listener.h"
+#include "lxpolkit-agent.h"
+#include "lxpolkit-probes.h"
+#include <glib/gi18n.h>
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef G_ENABLE_DEBUG
+#define DEBUG(...)  g_debug(__VA_ARGS__)
+#else
+#define DEBUG(...)
+#endif
+
+/* A canonical mode terminal hands over at most this much of a line. */
+#define TTY_LINE_MAX    4096
+
+#define REQUEST_PROBE(req, name)    LXPOLKIT_PROBE(name, (req)->cookie, (req)->action_id, (req)->start)
+
+static void lxpolkit_text_listener_finalize(GObject *object);
+
+G_DEFINE_TYPE(LXPolkitTextListener, lxpolkit_text_listener, POLKIT_AGENT_TYPE_LISTENER);
+
+typedef struct _TextRequest TextRequest;
+struct _TextRequest
+{
+    LXPolkitTextListener* listener;
+    GSimpleAsyncResult* result;
+    GCancellable* cancellable;
+    char* cookie;
+    char* action_id;
+    char* message;
+    gint64 start;                   /* monotonic time the request came in */
+    LXPolkitSessionManager* sessions;
+    PolkitIdentity* identity;       /* the selected identity */
+    GList* identities;              /* our references to the identities to choose from */
+    int n_identities;
+    char** names;                   /* display names, in the order of identities */
+    GSList* lookups;                /* NameLookups still in flight */
+    int default_index;
+    gboolean choosing;              /* the next line picks an identity */
+    char* prompt;                   /* question of the helper not asked yet */
+    gboolean echo_on;
+    guint prompt_source;
+    guint read_source;
+};
+
+/* A name resolved for a request that may be gone by then. */
+typedef struct _NameLookup NameLookup;
+struct _NameLookup
+{
+    TextRequest* req;
+    int index;
+};
+
+static void on_cancelled(GCancellable* cancellable, TextRequest* req);
+
+static void tty_printf(LXPolkitTextListener* self, const char* format, ...) G_GNUC_PRINTF(2, 3);
+
+static void tty_printf(LXPolkitTextListener* self, const char* format, ...)
+{
+    va_list args;
+    char* text;
+    gsize len, done = 0;
+    va_start(args, format);
+    text = g_strdup_vprintf(format, args);
+    va_end(args);
+    len = strlen(text);
+    while(done < len) {
+        ssize_t n = write(self->tty, text + done, len - done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+        done += n;
+    }
+    g_free(text);
+}
+
+static void tty_set_echo(LXPolkitTextListener* self, gboolean echo)
+{
+    struct termios t = self->saved;
+    if(!echo)
+        t.c_lflag &= ~ECHO;
+    tcsetattr(self->tty, TCSANOW, &t);
+}
+
+/* The terminal is only opened once there is something to ask. */
+static gboolean tty_open(LXPolkitTextListener* self, GError** error)
+{
+    int fd;
+    if(self->tty >= 0)
+        return TRUE;
+    fd = open("/dev/tty", O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if(fd < 0) {
+        int errsv = errno;
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv), "Cannot open the terminal: %s", g_strerror(errsv));
+        return FALSE;
+    }
+    if(tcgetattr(fd, &self->saved) < 0) {
+        int errsv = errno;
+        close(fd);
+        g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv), "Cannot use the terminal: %s", g_strerror(errsv));
+        return FALSE;
+    }
+    self->tty = fd;
+    lxpolkit_agent_trace("terminal opened");
+    return TRUE;
+}
+
+static void text_request_free(TextRequest* req)
+{
+    LXPolkitTextListener* self = req->listener;
+    GSList* l;
+    int i;
+
+    DEBUG("text_request_free");
+    lxpolkit_request_queue_remove(&self->requests, req);
+
+    if(req->read_source) {
+        g_source_remove(req->read_source);
+        /* leave the terminal as we found it */
+        tty_set_echo(self, TRUE);
+        tty_printf(self, "\n");
+    }
+    if(req->prompt_source)
+        g_source_remove(req->prompt_source);
+    for(l = req->lookups; l; l = l->next)
+        ((NameLookup*)l->data)->req = NULL;
+    g_slist_free(req->lookups);
+
+    g_signal_handlers_disconnect_by_func(req->cancellable, on_cancelled, req);
+    g_object_unref(req->cancellable);
+    lxpolkit_session_manager_free(req->sessions);
+    if(req->identity)
+        g_object_unref(req->identity);
+    g_list_free_full(req->identities, g_object_unref);
+    if(req->names) {
+        for(i = 0; i < req->n_identities; ++i)
+            g_free(req->names[i]);
+        g_free(req->names);
+    }
+    g_free(req->prompt);
+    g_free(req->message);
+    g_free(req->action_id);
+    g_free(req->cookie);
+    g_object_unref(req->result);
+    g_slice_free(TextRequest, req);
+}
+
+/* Clear memory that held an answer, in a way the compiler cannot drop. */
+static void wipe(char* buf, gsize len)
+{
+    volatile char* p = buf;
+    while(len--)
+        *p++ = 0;
+}
+
+static gboolean on_tty_input(gint fd, GIOCondition cond, gpointer user_data);
+
+static void watch_tty(TextRequest* req)
+{
+    req->read_source = g_unix_fd_add(req->listener->tty, G_IO_IN | G_IO_HUP | G_IO_ERR, on_tty_input, req);
+}
+
+/* A line was typed on the terminal. It is read straight from the terminal
+ * into a buffer on the stack, so no copy of an answer is left behind in
+ * a buffer we cannot wipe. */
+static gboolean on_tty_input(gint fd, GIOCondition cond, gpointer user_data)
+{
+    TextRequest* req = (TextRequest*)user_data;
+    LXPolkitTextListener* self = req->listener;
+    char line[TTY_LINE_MAX + 1];
+    ssize_t len;
+
+    do
+        len = read(fd, line, TTY_LINE_MAX);
+    while(len < 0 && errno == EINTR);
+    if(len < 0 && errno == EAGAIN)
+        return TRUE;
+    req->read_source = 0;
+    tty_set_echo(self, TRUE);
+    if(len <= 0) {
+        /* the terminal is gone, treat it like a cancel */
+        g_cancellable_cancel(req->cancellable);
+        return FALSE;
+    }
+    line[len] = '\0';
+    line[strcspn(line, "\r\n")] = '\0';
+    if(req->choosing) {
+        char* end;
+        guint64 n;
+        g_strstrip(line);
+        n = *line ? g_ascii_strtoull(line, &end, 10) : (guint64)req->default_index + 1;
+        if(*line && (*end || n < 1 || n > (guint64)req->n_identities)) {
+            tty_printf(self, _("Enter a number from 1 to %d: "), req->n_identities);
+            watch_tty(req);
+        } else {
+            req->choosing = FALSE;
+            if(req->identity)
+                g_object_unref(req->identity);
+            req->identity = (PolkitIdentity*)g_object_ref(g_list_nth_data(req->identities, n - 1));
+            lxpolkit_session_manager_select(req->sessions, req->identity, FALSE);
+        }
+    } else {
+        if(!req->echo_on)
+            tty_printf(self, "\n");
+        lxpolkit_session_manager_respond(req->sessions, line);
+        REQUEST_PROBE(req, response_sent);
+    }
+    wipe(line, sizeof(line));
+    return FALSE;
+}
+
+static void read_line(TextRequest* req, gboolean echo)
+{
+    LXPolkitTextListener* self = req->listener;
+    tty_set_echo(self, echo);
+    watch_tty(req);
+}
+
+/* Ask the question of the helper. It waits for the main loop, so that a
+ * failure reported right after a retry's question is printed before it. */
+static gboolean ask_prompt(gpointer user_data)
+{
+    TextRequest* req = (TextRequest*)user_data;
+    req->prompt_source = 0;
+    if(req->read_source) {
+        /* a new question replaces the one not answered yet */
+        g_source_remove(req->read_source);
+        req->read_source = 0;
+        tty_printf(req->listener, "\n");
+    }
+    tty_printf(req->listener, "%s", req->prompt);
+    g_free(req->prompt);
+    req->prompt = NULL;
+    read_line(req, req->echo_on);
+    return FALSE;
+}
+
+static void on_completed(gboolean authorized, gpointer user_data)
+{
+    TextRequest* req = (TextRequest*)user_data;
+    LXPolkitTextListener* self = req->listener;
+    DEBUG("on_complete");
+    REQUEST_PROBE(req, completed);
+
+    if(!authorized && !g_cancellable_is_cancelled(req->cancellable)) {
+        /* the session manager already moved on to a new session */
+        tty_printf(self, "%s\n", _("Authentication failed! Wrong password?"));
+        return;
+    }
+    if(authorized) {
+        /* offer the same identity first next time */
+        if(self->last_identity)
+            g_object_unref(self->last_identity);
+        self->last_identity = (PolkitIdentity*)g_object_ref(req->identity);
+        tty_printf(self, "%s\n", _("Authenticated"));
+    }
+    g_simple_async_result_complete(req->result);
+    text_request_free(req);
+}
+
+static void on_request(const char* request, gboolean echo_on, gpointer user_data)
+{
+    TextRequest* req = (TextRequest*)user_data;
+    DEBUG("on_request: %s", request);
+    REQUEST_PROBE(req, helper_request);
+    g_free(req->prompt);
+    req->prompt = g_strdup(strcmp("Password: ", request) == 0 ? _("Password: ") : request);
+    req->echo_on = echo_on;
+    if(!req->prompt_source)
+        req->prompt_source = g_idle_add(ask_prompt, req);
+}
+
+static void on_show_error(const char* text, gpointer user_data)
+{
+    TextRequest* req = (TextRequest*)user_data;
+    DEBUG("on error: %s", text);
+    tty_printf(req->listener, "%s\n", text);
+}
+
+static void on_show_info(const char* text, gpointer user_data)
+{
+    TextRequest* req = (TextRequest*)user_data;
+    DEBUG("on info: %s", text);
+    tty_printf(req->listener, "%s\n", text);
+}
+
+static const LXPolkitSessionFuncs session_funcs = {
+    on_completed,
+    on_request,
+    on_show_error,
+    on_show_info
+};
+
+void on_cancelled(GCancellable* cancellable, TextRequest* req)
+{
+    DEBUG("on_cancelled");
+    if(!lxpolkit_session_manager_cancel(req->sessions)) {
+        g_simple_async_result_complete_in_idle(req->result);
+        text_request_free(req);
+    }
+}
+
+/* Every name is known: list the identities and ask for one. */
+static void ask_identity(TextRequest* req)
+{
+    int i;
+    REQUEST_PROBE(req, identities_named);
+    for(i = 0; i < req->n_identities; ++i)
+        tty_printf(req->listener, "%3d. %s\n", i + 1, req->names[i]);
+    tty_printf(req->listener, _("Authenticate as [%d]: "), req->default_index + 1);
+    req->choosing = TRUE;
+    read_line(req, TRUE);
+}
+
+static void on_identity_resolved(const char* name, gpointer user_data)
+{
+    NameLookup* lookup = (NameLookup*)user_data;
+    TextRequest* req = lookup->req;
+    if(req) {
+        PolkitIdentity* id = (PolkitIdentity*)g_list_nth_data(req->identities, lookup->index);
+        req->names[lookup->index] = name ? g_strdup(name) : polkit_identity_to_string(id);
+        req->lookups = g_slist_remove(req->lookups, lookup);
+        if(!req->lookups)
+            ask_identity(req);
+    }
+    g_slice_free(NameLookup, lookup);
+}
+
+/* It is the turn of req to use the terminal. */
+static void start_request(TextRequest* req)
+{
+    LXPolkitTextListener* self = req->listener;
+    GError* err = NULL;
+    GList* l;
+    int i;
+
+    if(!tty_open(self, &err)) {
+        g_warning("%s", err->message);
+        g_simple_async_result_take_error(req->result, err);
+        g_simple_async_result_complete_in_idle(req->result);
+        text_request_free(req);
+        return;
+    }
+    tty_printf(self, "\n%s\n", req->message);
+
+    req->default_index = g_list_position(req->identities,
+                                         lxpolkit_identity_find_default(req->identities, self->last_identity, (gint)getuid()));
+    if(req->n_identities == 1) {
+        /* nothing to name or choose from */
+        REQUEST_PROBE(req, identities_named);
+        req->identity = (PolkitIdentity*)g_object_ref(req->identities->data);
+        lxpolkit_session_manager_select(req->sessions, req->identity, FALSE);
+        return;
+    }
+    /* look up the names not cached yet in parallel */
+    req->names = g_new0(char*, req->n_identities);
+    for(l = req->identities, i = 0; l; l = l->next, ++i) {
+        req->names[i] = lxpolkit_identity_cache_lookup(self->identities, (PolkitIdentity*)l->data);
+        if(!req->names[i]) {
+            NameLookup* lookup = g_slice_new(NameLookup);
+            lookup->req = req;
+            lookup->index = i;
+            req->lookups = g_slist_prepend(req->lookups, lookup);
+        }
+    }
+    if(!req->lookups) {
+        ask_identity(req);
+        return;
+    }
+    /* the lookups may finish right away; resolve a copy of the list */
+    {
+        GSList* lookups = g_slist_copy(req->lookups);
+        GSList* k;
+        for(k = lookups; k; k = k->next) {
+            NameLookup* lookup = (NameLookup*)k->data;
+            lxpolkit_identity_cache_resolve(self->identities, (PolkitIdentity*)g_list_nth_data(req->identities, lookup->index),
+                                            on_identity_resolved, lookup);
+        }
+        g_slist_free(lookups);
+    }
+}
+
+static void run_next_request(LXPolkitRequestQueue* queue, gpointer user_data)
+{
+    TextRequest* req = (TextRequest*)lxpolkit_request_queue_pop(queue, NULL);
+    if(req)
+        start_request(req);
+}
+
+static void initiate_authentication(PolkitAgentListener  *listener,
+                                    const gchar          *action_id,
+                                    const gchar          *message,
+                                    const gchar          *icon_name,
+                                    PolkitDetails        *details,
+                                    const gchar          *cookie,
+                                    GList                *identities,
+                                    GCancellable         *cancellable,
+                                    GAsyncReadyCallback   callback,
+                                    gpointer              user_data)
+{
+    LXPolkitTextListener* self = (LXPolkitTextListener*)listener;
+    TextRequest* req = g_slice_new0(TextRequest);
+    DEBUG("init_authentication");
+    DEBUG("action_id = %s", action_id);
+
+    req->listener = self;
+    req->result = g_simple_async_result_new(G_OBJECT (listener), callback, user_data, initiate_authentication);
+    req->cancellable = (GCancellable*)g_object_ref(cancellable);
+    req->cookie = g_strdup(cookie);
+    req->action_id = g_strdup(action_id);
+    req->message = g_strdup(message);
+    req->start = g_get_monotonic_time();
+    REQUEST_PROBE(req, request_received);
+    req->sessions = lxpolkit_session_manager_new(cookie, &session_funcs, req);
+    g_signal_connect(req->cancellable, "cancelled", G_CALLBACK(on_cancelled), req);
+
+    if(!identities) {
+        DEBUG("no identities list, is this an error?");
+        g_simple_async_result_set_error(req->result, POLKIT_ERROR, POLKIT_ERROR_FAILED, "No identities to authenticate as");
+        g_simple_async_result_complete_in_idle(req->result);
+        text_request_free(req);
+        return;
+    }
+    req->identities = g_list_copy_deep(identities, (GCopyFunc)g_object_ref, NULL);
+    req->n_identities = g_list_length(req->identities);
+
+    /* The terminal asks one request at a time. */
+    lxpolkit_request_queue_push(&self->requests, req);
+}
+
+static gboolean initiate_authentication_finish(PolkitAgentListener  *listener,
+                                              GAsyncResult         *res,
+                                              GError              **error)
+{
+    DEBUG("init_authentication_finish");
+    return !g_simple_async_result_propagate_error(G_SIMPLE_ASYNC_RESULT(res), error);
+}
+
+static void lxpolkit_text_listener_class_init(LXPolkitTextListenerClass *klass)
+{
+	GObjectClass *g_object_class;
+    PolkitAgentListenerClass* pkal_class;
+	g_object_class = G_OBJECT_CLASS(klass);
+	g_object_class->finalize = lxpolkit_text_listener_finalize;
+
+    pkal_class = POLKIT_AGENT_LISTENER_CLASS(klass);
+    pkal_class->initiate_authentication = initiate_authentication;
+    pkal_class->initiate_authentication_finish = initiate_authentication_finish;
+}
+
+static void lxpolkit_text_listener_finalize(GObject *object)
+{
+	LXPolkitTextListener *self;
+
+	g_return_if_fail(object != NULL);
+	g_return_if_fail(IS_LXPOLKIT_TEXT_LISTENER(object));
+
+	self = LXPOLKIT_TEXT_LISTENER(object);
+	lxpolkit_request_queue_clear(&self->requests);
+	lxpolkit_identity_cache_free(self->identities);
+	if(self->last_identity)
+		g_object_unref(self->last_identity);
+	if(self->tty >= 0) {
+		tcsetattr(self->tty, TCSANOW, &self->saved);
+		close(self->tty);
+	}
+
+	G_OBJECT_CLASS(lxpolkit_text_listener_parent_class)->finalize(object);
+}
+
+static void lxpolkit_text_listener_init(LXPolkitTextListener *self)
+{
+    self->tty = -1;
+    self->identities = lxpolkit_identity_cache_new();
+    lxpolkit_request_queue_init(&self->requests, run_next_request, self);
+}
+
+PolkitAgentListener *lxpolkit_text_listener_new(void)
+{
+	return g_object_new(LXPOLKIT_TEXT_LISTENER_TYPE, NULL);
+}
+
+void lxpolkit_text_listener_restore_tty(PolkitAgentListener* listener)
+{
+    LXPolkitTextListener* self = LXPOLKIT_TEXT_LISTENER(listener);
+    if(self->tty >= 0)
+        tcsetattr(self->tty, TCSANOW, &self->saved);
+}
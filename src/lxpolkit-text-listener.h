@@ -0,0 +1,73 @@
+/*
+ *      lxpolkit-text-listener.h
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+#ifndef __LXPOLKIT_TEXT_LISTENER_H__
+#define __LXPOLKIT_TEXT_LISTENER_H__
+
+#define POLKIT_AGENT_I_KNOW_API_IS_SUBJECT_TO_CHANGE
+#include <polkitagent/polkitagent.h>
+#include <termios.h>
+#include "lxpolkit-identity.h"
+#include "lxpolkit-queue.h"
+#include "lxpolkit-session.h"
+
+G_BEGIN_DECLS
+
+#define LXPOLKIT_TEXT_LISTENER_TYPE				(lxpolkit_text_listener_get_type())
+#define LXPOLKIT_TEXT_LISTENER(obj)				(G_TYPE_CHECK_INSTANCE_CAST((obj),\
+			LXPOLKIT_TEXT_LISTENER_TYPE, LXPolkitTextListener))
+#define LXPOLKIT_TEXT_LISTENER_CLASS(klass)		(G_TYPE_CHECK_CLASS_CAST((klass),\
+			LXPOLKIT_TEXT_LISTENER_TYPE, LXPolkitTextListenerClass))
+#define IS_LXPOLKIT_TEXT_LISTENER(obj)			(G_TYPE_CHECK_INSTANCE_TYPE((obj),\
+			LXPOLKIT_TEXT_LISTENER_TYPE))
+#define IS_LXPOLKIT_TEXT_LISTENER_CLASS(klass)	(G_TYPE_CHECK_CLASS_TYPE((klass),\
+			LXPOLKIT_TEXT_LISTENER_TYPE))
+
+/* Asks on the controlling terminal instead of in a window. Requests are
+ * answered one at a time, through the same helper sessions and identity
+ * cache as the GTK+ listener. */
+typedef struct _LXPolkitTextListener			LXPolkitTextListener;
+typedef struct _LXPolkitTextListenerClass		LXPolkitTextListenerClass;
+
+struct _LXPolkitTextListener
+{
+	PolkitAgentListener parent;
+	int tty;					/* opened for the first request */
+	struct termios saved;		/* terminal settings to restore */
+	LXPolkitIdentityCache* identities;
+	PolkitIdentity* last_identity;
+	LXPolkitRequestQueue requests;	/* one asks on the terminal at a time */
+};
+
+struct _LXPolkitTextListenerClass
+{
+	PolkitAgentListenerClass parent_class;
+};
+
+GType lxpolkit_text_listener_get_type(void);
+PolkitAgentListener* lxpolkit_text_listener_new(void);
+
+/* Put the terminal settings back as they were before the first request,
+ * for a process about to quit while a password is being asked for. */
+void lxpolkit_text_listener_restore_tty(PolkitAgentListener* listener);
+
+G_END_DECLS
+
+#endif /* __LXPOLKIT_TEXT_LISTENER_H__ */
@@ -0,0 +1,109 @@
+/*
+ *      lxpolkit-text.c
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/* The polkit agent for nodes without a display. It asks on the terminal
+ * it was started from and does not link GTK+. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib/gi18n.h>
+#include <glib-unix.h>
+#include <locale.h>
+#include <signal.h>
+
+#include "lxpolkit-agent.h"
+#include "lxpolkit-text-listener.h"
+
+static gboolean startup_trace = FALSE;
+
+static GMainLoop* loop;
+static int exit_status = 0;
+
+static GOptionEntry option_entries[] =
+{
+    { "startup-trace", 0, 0, G_OPTION_ARG_NONE, &startup_trace, N_("Print the time and memory use at each startup phase"), NULL },
+    { NULL }
+};
+
+static void on_registered(GObject* source, GAsyncResult* res, gpointer user_data)
+{
+    GError* err = NULL;
+    if(!lxpolkit_agent_register_finish(POLKIT_AGENT_LISTENER(source), res, &err)) {
+        g_printerr("Error: %s\n", err->message);
+        g_error_free(err);
+        exit_status = 1;
+        g_main_loop_quit(loop);
+        return;
+    }
+    lxpolkit_agent_trace("agent registered");
+}
+
+/* Echo is off on the terminal while a password is asked for. Put it back
+ * before quitting, or the shell the agent was started from is left
+ * without it. */
+static gboolean on_quit_signal(gpointer user_data)
+{
+    lxpolkit_text_listener_restore_tty((PolkitAgentListener*)user_data);
+    g_main_loop_quit(loop);
+    return TRUE;
+}
+
+int main(int argc, char** argv)
+{
+    GError* err = NULL;
+    GOptionContext* context;
+    PolkitAgentListener *listener;
+
+    lxpolkit_agent_trace_start();
+    setlocale(LC_ALL, "");
+
+    /* gettext support */
+#ifdef ENABLE_NLS
+    bindtextdomain ( GETTEXT_PACKAGE, PACKAGE_LOCALE_DIR );
+    bind_textdomain_codeset ( GETTEXT_PACKAGE, "UTF-8" );
+    textdomain ( GETTEXT_PACKAGE );
+#endif
+
+    context = g_option_context_new("");
+    g_option_context_add_main_entries(context, option_entries, GETTEXT_PACKAGE);
+    if( G_UNLIKELY( ! g_option_context_parse( context, &argc, &argv, &err ) ) )
+    {
+        g_print( "Error: %s\n", err->message );
+        return 1;
+    }
+    g_option_context_free(context);
+    lxpolkit_agent_set_trace(startup_trace);
+    lxpolkit_agent_trace("options parsed");
+
+    loop = g_main_loop_new(NULL, FALSE);
+    listener = lxpolkit_text_listener_new();
+    g_unix_signal_add(SIGINT, on_quit_signal, listener);
+    g_unix_signal_add(SIGTERM, on_quit_signal, listener);
+    g_unix_signal_add(SIGHUP, on_quit_signal, listener);
+    lxpolkit_agent_register(listener, NULL, NULL, on_registered, NULL);
+
+    g_main_loop_run(loop);
+
+    g_object_unref(listener);
+    g_main_loop_unref(loop);
+
+    return exit_status;
+}
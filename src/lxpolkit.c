@@ -26,19 +26,53 @@
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
 #include <sys/types.h>
+#include <pwd.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "lxpolkit-agent.h"
 #include "lxpolkit-listener.h"
+#include "lxpolkit-notify.h"
+
+static gint backdrop_scale = 1;
+static gboolean backdrop_blur = FALSE;
+static gboolean startup_trace = FALSE;
+static gint idle_trim = LXPOLKIT_IDLE_TRIM;
+static gint notify_interval = LXPOLKIT_NOTIFY_INTERVAL;
+static gchar** session_specs = NULL;
+
+static int exit_status = 0;
+
+/* A session served by a process that serves several of them. */
+typedef struct _AgentSession AgentSession;
+struct _AgentSession
+{
+    PolkitAgentListener* listener;
+    char* id;
+    char* object_path;
+};
+
+static GList* agents;
+static guint agents_pending;    /* sessions not registered yet */
+static guint agents_served;
 
 static GOptionEntry option_entries[] =
 {
+    { "backdrop-scale", 0, 0, G_OPTION_ARG_INT, &backdrop_scale, N_("Capture the backdrop at 1/N of the monitor resolution"), "N" },
+    { "blur", 0, 0, G_OPTION_ARG_NONE, &backdrop_blur, N_("Blur the backdrop instead of only darkening it"), NULL },
+    { "startup-trace", 0, 0, G_OPTION_ARG_NONE, &startup_trace, N_("Print the time and memory use at each startup phase and idle trim"), NULL },
+    { "idle-trim", 0, 0, G_OPTION_ARG_INT, &idle_trim, N_("Drop caches after N minutes without requests, 0 to keep them"), "N" },
+    { "notify-interval", 0, 0, G_OPTION_ARG_INT, &notify_interval, N_("Send at most one notification of a kind every N seconds, summing up the others, 0 to send each"), "N" },
+    { "session", 0, 0, G_OPTION_ARG_STRING_ARRAY, &session_specs, N_("Serve the logind session ID on DISPLAY, or on the display of the session, with the X authority file XAUTHORITY, or the one of the session. Repeat to serve several sessions; only root may serve other sessions"), N_("ID[@DISPLAY[@XAUTHORITY]]") },
     { NULL }
 };
 
-void show_msg(GtkWindow* parent, GtkMessageType type, const char* msg) {
+/* Show a message without waiting for it to be closed. The dialog destroys
+ * itself when it is answered. */
+GtkWidget* show_msg(GtkWindow* parent, GtkMessageType type, const char* msg) {
     g_object_set (gtk_settings_get_default (), "gtk-dialogs-use-header", TRUE, "gtk-application-prefer-dark-theme", TRUE, NULL);
     
-    GtkWidget* dlg = gtk_message_dialog_new(parent, GTK_DIALOG_MODAL, type, GTK_BUTTONS_OK, msg);
+    GtkWidget* dlg = gtk_message_dialog_new(parent, GTK_DIALOG_DESTROY_WITH_PARENT, type, GTK_BUTTONS_OK, "%s", msg);
     const char* title = NULL;
     switch(type)
     {
@@ -51,15 +85,206 @@ void show_msg(GtkWindow* parent, GtkMessageType type, const char* msg) {
     }
     if(title)
         gtk_window_set_title(GTK_WINDOW(dlg), title);
-    gtk_dialog_run(GTK_DIALOG(dlg));
-    gtk_widget_destroy(dlg);
+    g_signal_connect(dlg, "response", G_CALLBACK(gtk_widget_destroy), NULL);
+    gtk_widget_show(dlg);
+    return dlg;
+}
+
+/* Nothing else runs yet, so just wait for the message to be closed. */
+static void startup_failed(const char* msg) {
+    exit_status = 1;
+    if(gtk_init_check(NULL, NULL))
+        g_signal_connect(show_msg(NULL, GTK_MESSAGE_ERROR, msg), "destroy", G_CALLBACK(gtk_main_quit), NULL);
+    else {
+        g_printerr("Error: %s\n", msg);
+        gtk_main_quit();
+    }
+}
+
+static void on_registered(GObject* source, GAsyncResult* res, gpointer user_data) {
+    GError* err = NULL;
+    if(!lxpolkit_agent_register_finish(POLKIT_AGENT_LISTENER(source), res, &err)) {
+        startup_failed(err->message);
+        g_error_free(err);
+        return;
+    }
+    lxpolkit_agent_trace("agent registered");
+}
+
+static PolkitAgentListener* create_listener(void) {
+    PolkitAgentListener* listener = lxpolkit_listener_new();
+    lxpolkit_backdrop_set_scale(LXPOLKIT_LISTENER(listener)->backdrop, backdrop_scale);
+    lxpolkit_backdrop_set_blur(LXPOLKIT_LISTENER(listener)->backdrop, backdrop_blur);
+    lxpolkit_listener_set_idle_trim(LXPOLKIT_LISTENER(listener), MAX(idle_trim, 0));
+    return listener;
+}
+
+static void agent_session_free(AgentSession* agent) {
+    g_object_unref(agent->listener);
+    g_free(agent->object_path);
+    g_free(agent->id);
+    g_slice_free(AgentSession, agent);
+}
+
+static void on_session_registered(GObject* source, GAsyncResult* res, gpointer user_data) {
+    AgentSession* agent = (AgentSession*)user_data;
+    GError* err = NULL;
+    --agents_pending;
+    if(lxpolkit_agent_register_finish(POLKIT_AGENT_LISTENER(source), res, &err)) {
+        char* phase = g_strdup_printf("agent of session %s registered", agent->id);
+        lxpolkit_agent_trace(phase);
+        g_free(phase);
+        ++agents_served;
+    } else {
+        /* the other sessions are still served */
+        g_warning("Cannot serve session %s: %s", agent->id, err->message);
+        g_error_free(err);
+    }
+    if(!agents_pending && !agents_served) {
+        exit_status = 1;
+        gtk_main_quit();
+    }
+}
+
+static void register_session(AgentSession* agent) {
+    PolkitSubject* session = polkit_unix_session_new(agent->id);
+    lxpolkit_agent_register(agent->listener, session, agent->object_path, on_session_registered, agent);
+    g_object_unref(session);
+}
+
+/* The X authority file of a session, which an X server lets nobody in
+ * without: XAUTHORITY in the environment of the session leader, else the
+ * first file found where display managers put it. NULL if there is none. */
+static char* find_xauthority(guint32 leader, guint32 uid) {
+    char* path = g_strdup_printf("/proc/%u/environ", leader);
+    char* env;
+    gsize len;
+    char* found = NULL;
+    if(leader && g_file_get_contents(path, &env, &len, NULL)) {
+        const char* p;
+        for(p = env; p < env + len && !found; p += strlen(p) + 1)
+            if(g_str_has_prefix(p, "XAUTHORITY=") && g_path_is_absolute(p + 11))
+                found = g_strdup(p + 11);
+        g_free(env);
+    }
+    g_free(path);
+    if(!found) {
+        struct passwd* pw = getpwuid(uid);
+        char* candidates[] = {
+            g_strdup_printf("/run/user/%u/gdm/Xauthority", uid),
+            g_strdup_printf("/run/user/%u/Xauthority", uid),
+            pw ? g_build_filename(pw->pw_dir, ".Xauthority", NULL) : NULL
+        };
+        guint i;
+        for(i = 0; i < G_N_ELEMENTS(candidates); ++i) {
+            if(!found && candidates[i] && g_file_test(candidates[i], G_FILE_TEST_IS_REGULAR))
+                found = candidates[i];
+            else
+                g_free(candidates[i]);
+        }
+    }
+    return found;
+}
+
+/* The display, the user and the X authority of the session, as logind
+ * knows them. */
+static void on_session_properties(GObject* source, GAsyncResult* res, gpointer user_data) {
+    AgentSession* agent = (AgentSession*)user_data;
+    LXPolkitListener* listener = LXPOLKIT_LISTENER(agent->listener);
+    GError* err = NULL;
+    GVariant* ret = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &err);
+    if(ret) {
+        GVariant* props;
+        const char* display;
+        guint32 uid, leader = 0;
+        g_variant_get(ret, "(@a{sv})", &props);
+        if(!listener->display_name && g_variant_lookup(props, "Display", "&s", &display) && *display)
+            lxpolkit_listener_set_display_name(listener, display);
+        g_variant_lookup(props, "Leader", "u", &leader);
+        if(g_variant_lookup(props, "User", "(uo)", &uid, NULL)) {
+            lxpolkit_listener_set_user(listener, uid);
+            if(!listener->xauthority && uid != getuid()) {
+                char* xauthority = find_xauthority(leader, uid);
+                if(xauthority)
+                    lxpolkit_listener_set_xauthority(listener, xauthority);
+                else
+                    g_warning("No X authority found for session %s, give it as %s@DISPLAY@XAUTHORITY",
+                              agent->id, agent->id);
+                g_free(xauthority);
+            }
+        }
+        g_variant_unref(props);
+        g_variant_unref(ret);
+    } else {
+        g_warning("Cannot look up session %s: %s", agent->id, err->message);
+        g_error_free(err);
+    }
+    register_session(agent);
+}
+
+static void on_session_path(GObject* source, GAsyncResult* res, gpointer user_data) {
+    AgentSession* agent = (AgentSession*)user_data;
+    GError* err = NULL;
+    const char* path;
+    GVariant* ret = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &err);
+    if(!ret) {
+        g_warning("Cannot look up session %s: %s", agent->id, err->message);
+        g_error_free(err);
+        register_session(agent);
+        return;
+    }
+    g_variant_get(ret, "(&o)", &path);
+    g_dbus_connection_call(G_DBUS_CONNECTION(source), "org.freedesktop.login1", path,
+                           "org.freedesktop.DBus.Properties", "GetAll",
+                           g_variant_new("(s)", "org.freedesktop.login1.Session"), G_VARIANT_TYPE("(a{sv})"),
+                           G_DBUS_CALL_FLAGS_NONE, -1, NULL, on_session_properties, agent);
+    g_variant_unref(ret);
+}
+
+static void on_system_bus(GObject* source, GAsyncResult* res, gpointer user_data) {
+    AgentSession* agent = (AgentSession*)user_data;
+    GError* err = NULL;
+    GDBusConnection* bus = g_bus_get_finish(res, &err);
+    if(!bus) {
+        g_warning("Cannot look up session %s: %s", agent->id, err->message);
+        g_error_free(err);
+        register_session(agent);
+        return;
+    }
+    g_dbus_connection_call(bus, "org.freedesktop.login1", "/org/freedesktop/login1",
+                           "org.freedesktop.login1.Manager", "GetSession",
+                           g_variant_new("(s)", agent->id), G_VARIANT_TYPE("(o)"),
+                           G_DBUS_CALL_FLAGS_NONE, -1, NULL, on_session_path, agent);
+    g_object_unref(bus);
+}
+
+/* Serve the session given as ID[@DISPLAY[@XAUTHORITY]] with a listener of
+ * its own, so dialogs, backdrops and queued requests are never mixed up
+ * between sessions. Each listener is exported at its own object path n. */
+static void add_session(const char* spec, guint n) {
+    AgentSession* agent = g_slice_new0(AgentSession);
+    char** parts = g_strsplit(spec, "@", 3);
+    agent->id = g_strdup(parts[0]);
+    agent->listener = create_listener();
+    if(parts[0] && parts[1] && *parts[1])
+        lxpolkit_listener_set_display_name(LXPOLKIT_LISTENER(agent->listener), parts[1]);
+    if(parts[0] && parts[1] && parts[2] && *parts[2])
+        lxpolkit_listener_set_xauthority(LXPOLKIT_LISTENER(agent->listener), parts[2]);
+    g_strfreev(parts);
+    agent->object_path = g_strdup_printf("/org/freedesktop/PolicyKit1/AuthenticationAgent/%u", n);
+    agents = g_list_prepend(agents, agent);
+    ++agents_pending;
+    g_bus_get(G_BUS_TYPE_SYSTEM, NULL, on_system_bus, agent);
 }
 
 int main(int argc, char** argv)
 {
     GError* err = NULL;
-    PolkitAgentListener *listener;
-    PolkitSubject* session;
+    GOptionContext* context;
+    PolkitAgentListener *listener = NULL;
+    guint i;
+
+    lxpolkit_agent_trace_start();
 
     /* gettext support */
 #ifdef ENABLE_NLS
@@ -68,30 +293,38 @@ int main(int argc, char** argv)
     textdomain ( GETTEXT_PACKAGE );
 #endif
 
-    /* initialize GTK+ and parse the command line arguments */
-    if( G_UNLIKELY( ! gtk_init_with_args( &argc, &argv, "", option_entries, GETTEXT_PACKAGE, &err ) ) )
+    /* Parse the command line arguments. GTK+ takes its own options now, but
+     * only opens the display when the first request is shown. */
+    context = g_option_context_new("");
+    g_option_context_add_main_entries(context, option_entries, GETTEXT_PACKAGE);
+    g_option_context_add_group(context, gtk_get_option_group(FALSE));
+    if( G_UNLIKELY( ! g_option_context_parse( context, &argc, &argv, &err ) ) )
     {
         g_print( "Error: %s\n", err->message );
         return 1;
     }
+    g_option_context_free(context);
+    lxpolkit_agent_set_trace(startup_trace);
+    lxpolkit_agent_trace("options parsed");
 
-    listener = lxpolkit_listener_new();
-    session = polkit_unix_session_new_for_process_sync(getpid(), NULL, NULL);
+    lxpolkit_notify_set_interval(MAX(notify_interval, 0));
 
-    if(!polkit_agent_register_listener(listener, session, NULL, &err))
-    {
-        /* show error msg */
-        g_object_unref(listener);
-        g_object_unref(session);
-        show_msg(NULL, GTK_MESSAGE_ERROR, err->message);
-        return 1;
+    /* Look up the sessions and register the agents while the main loop runs. */
+    if(session_specs) {
+        for(i = 0; session_specs[i]; ++i)
+            add_session(session_specs[i], i);
+    } else {
+        listener = create_listener();
+        lxpolkit_agent_register(listener, NULL, NULL, on_registered, NULL);
     }
 
     gtk_main();
 
-    g_object_unref(listener);
-    g_object_unref(session);
+    if(listener)
+        g_object_unref(listener);
+    g_list_free_full(agents, (GDestroyNotify)agent_session_free);
+    g_strfreev(session_specs);
 
-	return 0;
+	return exit_status;
 }
 
@@ -1,102 +1,244 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 
-#define IS_BLANK(ch)	strchr(" \t\n\r", ch)
+#define CHUNK_SIZE	65536
 
-static void purge_file( const char* file )
+/* blank characters, looked up instead of searched for */
+static gboolean is_blank[256];
+
+#define IS_BLANK(ch)	is_blank[(guchar)(ch)]
+
+typedef enum
 {
-	char* buf, *pbuf;
-	int in_tag = 0, in_quote = 0;
-	FILE* fo;
+	IN_TEXT,
+	IN_TEXT_BLANKS,	/* blanks that go if a tag follows */
+	IN_OPEN,		/* after '<', maybe the start of a comment */
+	IN_COMMENT,
+	IN_TAG,
+	IN_TAG_BLANKS,	/* blanks that become one, or none before '>' */
+	IN_QUOTE
+} PurgeState;
 
-    if(!g_file_get_contents(file, &buf, NULL, NULL))
-        exit(1);
+/* The state is kept between chunks, so a file is never read as a whole. */
+typedef struct
+{
+	PurgeState state;
+	int matched;	/* chars of "<!--" seen, or trailing dashes in a comment */
+	GString* blanks;
+	FILE* fo;
+} Purger;
 
-	fo = fopen( file, "w" );
-	if( ! fo )
-		goto error;
+static void purge_chunk( Purger* p, const char* buf, const char* end )
+{
+	const char* run;
 
-	for( pbuf = buf; *pbuf; ++pbuf )
+	while( buf < end )
 	{
-		if( in_tag > 0 )
+		switch( p->state )
 		{
-			if( in_quote )
+		case IN_TEXT:
+			/* copy everything up to the next blank or tag at once */
+			for( run = buf; buf < end && ! IS_BLANK( *buf ) && *buf != '<'; ++buf );
+			fwrite( run, 1, buf - run, p->fo );
+			if( buf == end )
+				break;
+			if( *buf == '<' )
 			{
-				if( *pbuf == '\"' )
-					in_quote = 0;
+				p->state = IN_OPEN;
+				p->matched = 1;
+				++buf;
 			}
 			else
+				p->state = IN_TEXT_BLANKS;
+			break;
+		case IN_TEXT_BLANKS:
+			for( run = buf; buf < end && IS_BLANK( *buf ); ++buf );
+			g_string_append_len( p->blanks, run, buf - run );
+			if( buf == end )
+				break;
+			if( *buf != '<' )	/* not blank, keep the cdata */
+				fwrite( p->blanks->str, 1, p->blanks->len, p->fo );
+			g_string_truncate( p->blanks, 0 );
+			p->state = IN_TEXT;
+			break;
+		case IN_OPEN:
+			if( *buf == "<!--"[ p->matched ] )
 			{
-				if( *pbuf == '\"' )
-					++in_quote;
-				if( ! in_quote && IS_BLANK(*pbuf) )	/* skip unnecessary blanks */
+				++buf;
+				if( ++p->matched == 4 )
 				{
-					do{
-						++pbuf;
-					}while( IS_BLANK( *pbuf ) );
-
-					if( *pbuf != '>' )
-						fputc( ' ', fo );
-					--pbuf;
-					continue;
+					/* "<!-->" closes the comment right away */
+					p->state = IN_COMMENT;
+					p->matched = 2;
 				}
+				break;
 			}
-			if( *pbuf == '>' )
-				--in_tag;
-			fputc( *pbuf, fo );
-		}
-		else
-		{
-			if( *pbuf == '<' )
+			/* a tag after all */
+			fwrite( "<!-", 1, p->matched, p->fo );
+			p->state = IN_TAG;
+			break;
+		case IN_COMMENT:	/* skip comments */
+			for( ; buf < end; ++buf )
 			{
-				if( 0 == strncmp( pbuf, "<!--", 4 ) )	/* skip comments */
+				if( *buf == '>' && p->matched == 2 )
 				{
-					pbuf = strstr( pbuf, "-->" );
-					if( ! pbuf )
-						goto error;
-					pbuf += 2;
-					continue;
+					++buf;
+					p->state = IN_TEXT;
+					break;
 				}
-				++in_tag;
-				fputc( '<', fo );
+				p->matched = *buf == '-' ? MIN( p->matched + 1, 2 ) : 0;
 			}
+			break;
+		case IN_TAG:
+			for( run = buf; buf < end && ! IS_BLANK( *buf ) && *buf != '\"' && *buf != '>'; ++buf );
+			fwrite( run, 1, buf - run, p->fo );
+			if( buf == end )
+				break;
+			if( IS_BLANK( *buf ) )
+				p->state = IN_TAG_BLANKS;
 			else
 			{
-				char* tmp = pbuf;
-				while( *tmp && IS_BLANK( *tmp ) && *tmp != '<' )
-					++tmp;
-				if( *tmp == '<' )	/* all cdata are blank characters */
-					pbuf = tmp - 1;
-				else /* not blank, keep the cdata */
-				{
-					if( tmp == pbuf )
-						fputc( *pbuf, fo );
-					else
-					{
-						fwrite( pbuf, 1, tmp - pbuf, fo );
-						pbuf = tmp - 1;
-					}
-				}
+				fputc( *buf, p->fo );
+				p->state = *buf == '>' ? IN_TEXT : IN_QUOTE;
+			}
+			++buf;
+			break;
+		case IN_TAG_BLANKS:	/* skip unnecessary blanks */
+			while( buf < end && IS_BLANK( *buf ) )
+				++buf;
+			if( buf == end )
+				break;
+			if( *buf != '>' )
+				fputc( ' ', p->fo );
+			p->state = IN_TAG;
+			break;
+		case IN_QUOTE:
+			run = memchr( buf, '\"', end - buf );
+			if( run )
+			{
+				++run;
+				p->state = IN_TAG;
 			}
+			else
+				run = end;
+			fwrite( buf, 1, run - buf, p->fo );
+			buf = run;
+			break;
+		}
+	}
+}
+
+/* Write what was held back for the end of the file. Fails on a comment
+ * that is not closed. */
+static gboolean purge_finish( Purger* p )
+{
+	switch( p->state )
+	{
+	case IN_TEXT_BLANKS:
+		fwrite( p->blanks->str, 1, p->blanks->len, p->fo );
+		break;
+	case IN_OPEN:
+		fwrite( "<!-", 1, p->matched, p->fo );
+		break;
+	case IN_TAG_BLANKS:
+		fputc( ' ', p->fo );
+		break;
+	case IN_COMMENT:
+		return FALSE;
+	default:
+		break;
+	}
+	return TRUE;
+}
+
+/* Purge file into a temporary file next to it, which replaces it only once
+ * it is complete. On any error the file is left as it was. */
+static gboolean purge_file( const char* file )
+{
+	Purger p = { IN_TEXT, 0, NULL, NULL };
+	struct stat st;
+	char* buf, *tmp;
+	const char* error = NULL;
+	FILE* fi;
+	size_t n;
+	int fd;
+
+	fi = g_fopen( file, "rb" );
+	if( ! fi || fstat( fileno( fi ), &st ) < 0 )
+	{
+		g_printerr( "xml-purge: %s: %s\n", file, g_strerror( errno ) );
+		if( fi )
+			fclose( fi );
+		return FALSE;
+	}
+
+	tmp = g_strconcat( file, ".XXXXXX", NULL );
+	fd = g_mkstemp( tmp );
+	if( fd < 0 || fchmod( fd, st.st_mode & 07777 ) < 0 || ! ( p.fo = fdopen( fd, "wb" ) ) )
+	{
+		g_printerr( "xml-purge: %s: %s\n", tmp, g_strerror( errno ) );
+		if( fd >= 0 )
+		{
+			close( fd );
+			g_unlink( tmp );
 		}
+		g_free( tmp );
+		fclose( fi );
+		return FALSE;
 	}
-	
-	fclose( fo );
 
-error:
-	free( buf );
+	p.blanks = g_string_new( NULL );
+	buf = g_malloc( CHUNK_SIZE );
+	while( ( n = fread( buf, 1, CHUNK_SIZE, fi ) ) > 0 )
+		purge_chunk( &p, buf, buf + n );
+	if( ferror( fi ) )
+		error = g_strerror( errno );
+	else if( ! purge_finish( &p ) )
+		error = "unterminated comment";
+	fclose( fi );
+	g_free( buf );
+	g_string_free( p.blanks, TRUE );
+
+	if( fclose( p.fo ) != 0 && ! error )
+		error = g_strerror( errno );
+	if( ! error && g_rename( tmp, file ) < 0 )
+		error = g_strerror( errno );
+	if( error )
+	{
+		g_printerr( "xml-purge: %s: %s\n", file, error );
+		g_unlink( tmp );
+	}
+	g_free( tmp );
+	return ! error;
+}
+
+static void purge_worker( gpointer file, gpointer failed )
+{
+	if( ! purge_file( (const char*)file ) )
+		g_atomic_int_set( (gint*)failed, 1 );
 }
 
 int main( int argc, char** argv )
 {
+	GThreadPool* pool;
+	gint failed = 0;
 	int i;
 	if( argc < 2 )
 		return 1;
 
+	is_blank[ ' ' ] = is_blank[ '\t' ] = is_blank[ '\n' ] = is_blank[ '\r' ] = TRUE;
+
+	/* the files are independent, purge them side by side */
+	pool = g_thread_pool_new( purge_worker, &failed, MIN( argc - 1, (int)g_get_num_processors() ), TRUE, NULL );
 	for( i = 1; i < argc; ++i )
-		purge_file( argv[ i] );
+		g_thread_pool_push( pool, argv[ i ], NULL );
+	g_thread_pool_free( pool, FALSE, TRUE );
 
-	return 0;
+	return failed;
 }